@@ -53,6 +53,21 @@ VERSION: 0.6.77
 #    include <nmmintrin.h>
 #endif
 
+/*
+ CHESS_CPU_DISPATCH builds a function for the baseline, popcnt and x86-64-v3 (BMI1/2, AVX2, LZCNT) instruction
+ sets, and the loader picks the best one for the host (GCC/Clang function multiversioning through ifunc).
+ Bitboard::count() and friends are inlined, so hot functions marked with it use the host's popcnt/blsr/shrx
+ without the binary requiring them. Define CHESS_NO_CPU_DISPATCH to build only one version.
+*/
+#if !defined(CHESS_NO_CPU_DISPATCH) && defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute)
+#    if __has_attribute(target_clones)
+#        define CHESS_CPU_DISPATCH __attribute__((target_clones("default", "popcnt", "arch=x86-64-v3")))
+#    endif
+#endif
+#ifndef CHESS_CPU_DISPATCH
+#    define CHESS_CPU_DISPATCH
+#endif
+
 
 #include <string_view>
 
@@ -620,6 +635,9 @@ class Bitboard {
 
     [[nodiscard]] constexpr bool empty() const noexcept { return bits == 0; }
 
+    // cheaper than count() > 1 where the baseline build has no popcnt instruction
+    [[nodiscard]] constexpr bool moreThanOne() const noexcept { return bits & (bits - 1); }
+
     [[nodiscard]]
 #if !defined(_MSC_VER)
     constexpr
@@ -708,6 +726,8 @@ constexpr Bitboard operator|(std::uint64_t lhs, const Bitboard& rhs) { return rh
 }  // namespace chess
 
 namespace chess {
+template <typename Derived>
+class BasicBoard;
 class Board;
 }  // namespace chess
 
@@ -1434,6 +1454,8 @@ enum PieceGenType {
     KING   = 32,
 };
 
+template <typename Derived>
+class BasicBoard;
 class Board;
 
 class movegen {
@@ -1443,42 +1465,107 @@ class movegen {
     /**
      * @brief Generates all legal moves for a position.
      * @tparam mt
+     * @tparam BoardT chess::Board or any type exposing the same accessors
+     * (us, occ, pieces, kingSq, at, sideToMove, enpassantSq, castlingRights, chess960).
      * @param movelist
      * @param board
      * @param pieces
      */
-    template <MoveGenType mt = MoveGenType::ALL>
-    void static legalmoves(Movelist &movelist, const Board &board,
+    template <MoveGenType mt = MoveGenType::ALL, typename BoardT = Board>
+    void static legalmoves(Movelist &movelist, const BoardT &board,
+                           int pieces = PieceGenType::PAWN | PieceGenType::KNIGHT | PieceGenType::BISHOP |
+                                        PieceGenType::ROOK | PieceGenType::QUEEN | PieceGenType::KING);
+
+    /**
+     * @brief Check and pin masks of the side to move, and the squares the opponent attacks with the own king
+     * taken off the board. Computed once per position with nodeInfo(), it can be passed to several
+     * legalmoves() and isLegal() calls instead of each recomputing it.
+     */
+    struct NodeInfo {
+        Bitboard checkmask;
+        Bitboard pin_hv;
+        Bitboard pin_d;
+        Bitboard seen;
+        int checks;
+    };
+
+    template <typename BoardT = Board>
+    [[nodiscard]] static NodeInfo nodeInfo(const BoardT &board);
+
+    /**
+     * @brief Generates all legal moves for a position, reusing its nodeInfo().
+     */
+    template <MoveGenType mt = MoveGenType::ALL, typename BoardT = Board>
+    void static legalmoves(Movelist &movelist, const BoardT &board, const NodeInfo &info,
                            int pieces = PieceGenType::PAWN | PieceGenType::KNIGHT | PieceGenType::BISHOP |
                                         PieceGenType::ROOK | PieceGenType::QUEEN | PieceGenType::KING);
 
+    /**
+     * @brief Per-node data for givesCheck: the squares from which each piece type of the side to move
+     * attacks the enemy king, and the side to move's pieces that block one of its own sliders from it.
+     */
+    struct CheckInfo {
+        std::array<Bitboard, 6> check_squares;
+        Bitboard blockers;
+        Square king_sq;
+    };
+
+    template <typename BoardT = Board>
+    [[nodiscard]] static CheckInfo checkInfo(const BoardT &board);
+
+    /**
+     * @brief Checks if a legal move gives check, without making it. Handles discovered checks,
+     * castling, en passant and promotions.
+     * @param info checkInfo() of the same position
+     */
+    template <typename BoardT = Board>
+    [[nodiscard]] static bool givesCheck(const BoardT &board, const Move &move, const CheckInfo &info);
+
+    /**
+     * @brief Checks if a move, e.g. a killer or hash move from another position, is playable here when
+     * self-check is ignored. Castling is only checked for rights and pieces, isLegal() does the rest.
+     */
+    template <typename BoardT = Board>
+    [[nodiscard]] static bool isPseudoLegal(const BoardT &board, const Move &move);
+
+    /**
+     * @brief Checks if a pseudo-legal move does not leave the own king in check, using the same check and
+     * pin masks as legalmoves().
+     */
+    template <typename BoardT = Board>
+    [[nodiscard]] static bool isLegal(const BoardT &board, const Move &move);
+
+    template <typename BoardT = Board>
+    [[nodiscard]] static bool isLegal(const BoardT &board, const Move &move, const NodeInfo &info);
+
    private:
     static auto init_squares_between();
     static const std::array<std::array<Bitboard, 64>, 64> SQUARES_BETWEEN_BB;
 
     // Generate the checkmask. Returns a bitboard where the attacker path between the king and enemy piece is set.
-    template <Color::underlying c>
-    [[nodiscard]] static std::pair<Bitboard, int> checkMask(const Board &board, Square sq);
+    template <Color::underlying c, typename BoardT>
+    [[nodiscard]] static std::pair<Bitboard, int> checkMask(const BoardT &board, Square sq);
 
     // Generate the pin mask for horizontal and vertical pins. Returns a bitboard where the ray between the king and the
     // pinner is set.
-    template <Color::underlying c>
-    [[nodiscard]] static Bitboard pinMaskRooks(const Board &board, Square sq, Bitboard occ_enemy, Bitboard occ_us);
+    template <Color::underlying c, typename BoardT>
+    [[nodiscard]] static Bitboard pinMaskRooks(const BoardT &board, Square sq, Bitboard occ_enemy, Bitboard occ_us);
 
     // Generate the pin mask for diagonal pins. Returns a bitboard where the ray between the king and the pinner is set.
-    template <Color::underlying c>
-    [[nodiscard]] static Bitboard pinMaskBishops(const Board &board, Square sq, Bitboard occ_enemy, Bitboard occ_us);
+    template <Color::underlying c, typename BoardT>
+    [[nodiscard]] static Bitboard pinMaskBishops(const BoardT &board, Square sq, Bitboard occ_enemy, Bitboard occ_us);
 
     // Returns the squares that are attacked by the enemy
-    template <Color::underlying c>
-    [[nodiscard]] static Bitboard seenSquares(const Board &board, Bitboard enemy_empty);
+    template <Color::underlying c, typename BoardT>
+    [[nodiscard]] static Bitboard seenSquares(const BoardT &board, Bitboard enemy_empty);
 
     // Generate pawn moves.
-    template <Color::underlying c, MoveGenType mt>
-    static void generatePawnMoves(const Board &board, Movelist &moves, Bitboard pin_d, Bitboard pin_hv,
+    template <Color::underlying c, MoveGenType mt, typename BoardT>
+    static void generatePawnMoves(const BoardT &board, Movelist &moves, Bitboard pin_d, Bitboard pin_hv,
                                   Bitboard checkmask, Bitboard occ_enemy);
 
-    [[nodiscard]] static std::array<Move, 2> generateEPMove(const Board &board, Bitboard checkmask, Bitboard pin_d,
+    template <typename BoardT>
+    [[nodiscard]] static std::array<Move, 2> generateEPMove(const BoardT &board, Bitboard checkmask, Bitboard pin_d,
                                                             Bitboard pawns_lr, Square ep, Color c);
 
     [[nodiscard]] static Bitboard generateKnightMoves(Square sq);
@@ -1491,18 +1578,26 @@ class movegen {
 
     [[nodiscard]] static Bitboard generateKingMoves(Square sq, Bitboard seen, Bitboard movable_square);
 
-    template <Color::underlying c, MoveGenType mt>
-    [[nodiscard]] static Bitboard generateCastleMoves(const Board &board, Square sq, Bitboard seen, Bitboard pinHV);
+    template <Color::underlying c, MoveGenType mt, typename BoardT>
+    [[nodiscard]] static Bitboard generateCastleMoves(const BoardT &board, Square sq, Bitboard seen, Bitboard pinHV);
 
     template <typename T>
     static void whileBitboardAdd(Movelist &movelist, Bitboard mask, T func);
 
-    template <Color::underlying c, MoveGenType mt>
-    static void legalmoves(Movelist &movelist, const Board &board, int pieces);
+    template <Color::underlying c, typename BoardT>
+    [[nodiscard]] CHESS_CPU_DISPATCH static NodeInfo nodeInfo(const BoardT &board);
 
-    template <Color::underlying c>
-    static bool isEpSquareValid(const Board &board, Square ep);
+    template <Color::underlying c, MoveGenType mt, typename BoardT>
+    static void legalmoves(Movelist &movelist, const BoardT &board, const NodeInfo &info, int pieces);
+
+    template <Color::underlying c, typename BoardT>
+    static bool isEpSquareValid(const BoardT &board, Square ep);
 
+    template <Color::underlying c, typename BoardT>
+    [[nodiscard]] static bool isLegal(const BoardT &board, const Move &move, const NodeInfo &info);
+
+    template <typename>
+    friend class BasicBoard;
     friend class Board;
 };
 
@@ -1697,6 +1792,7 @@ class Zobrist {
 
     static constexpr int MAP_HASH_PIECE[12] = {1, 3, 5, 7, 9, 11, 0, 2, 4, 6, 8, 10};
 
+   public:
         [[nodiscard]] static U64 piece(Piece piece, Square square) noexcept {
         assert(piece < 12);
 #if __cplusplus >= 202207L
@@ -1731,7 +1827,8 @@ class Zobrist {
 
     [[nodiscard]] static U64 sideToMove() noexcept { return RANDOM_ARRAY[780]; }
 
-   public:
+    template <typename>
+    friend class BasicBoard;
     friend class Board;
 };
 
@@ -1754,57 +1851,69 @@ enum class GameResultReason {
 // does not include the half-move clock or full move number.
 using PackedBoard = std::array<std::uint8_t, 24>;
 
-class Board {
-    using U64 = std::uint64_t;
-
+/**
+ * @brief Rook files that can still castle, per color and side.
+ */
+class CastlingRights {
    public:
-    class CastlingRights {
-       public:
-        enum class Side : uint8_t { KING_SIDE, QUEEN_SIDE };
-
-        void setCastlingRight(Color color, Side castle, File rook_file) {
-            rooks[color][static_cast<int>(castle)] = rook_file;
-        }
+    enum class Side : uint8_t { KING_SIDE, QUEEN_SIDE };
 
-        void clear() {
-            rooks[0].fill(File::NO_FILE);
-            rooks[1].fill(File::NO_FILE);
-        }
+    void setCastlingRight(Color color, Side castle, File rook_file) {
+        rooks[color][static_cast<int>(castle)] = rook_file;
+    }
 
-        int clear(Color color, Side castle) {
-            rooks[color][static_cast<int>(castle)] = File::NO_FILE;
-            return color * 2 + static_cast<int>(castle);
-        }
+    void clear() {
+        rooks[0].fill(File::NO_FILE);
+        rooks[1].fill(File::NO_FILE);
+    }
 
-        void clear(Color color) { rooks[color].fill(File::NO_FILE); }
+    int clear(Color color, Side castle) {
+        rooks[color][static_cast<int>(castle)] = File::NO_FILE;
+        return color * 2 + static_cast<int>(castle);
+    }
 
-        bool has(Color color, Side castle) const { return rooks[color][static_cast<int>(castle)] != File::NO_FILE; }
+    void clear(Color color) { rooks[color].fill(File::NO_FILE); }
 
-        bool has(Color color) const {
-            return rooks[color][static_cast<int>(Side::KING_SIDE)] != File::NO_FILE ||
-                   rooks[color][static_cast<int>(Side::QUEEN_SIDE)] != File::NO_FILE;
-        }
+    bool has(Color color, Side castle) const { return rooks[color][static_cast<int>(castle)] != File::NO_FILE; }
 
-        File getRookFile(Color color, Side castle) const { return rooks[color][static_cast<int>(castle)]; }
+    bool has(Color color) const {
+        return rooks[color][static_cast<int>(Side::KING_SIDE)] != File::NO_FILE ||
+               rooks[color][static_cast<int>(Side::QUEEN_SIDE)] != File::NO_FILE;
+    }
 
-        int hashIndex() const {
-            return has(Color::WHITE, Side::KING_SIDE) + 2 * has(Color::WHITE, Side::QUEEN_SIDE) +
-                   4 * has(Color::BLACK, Side::KING_SIDE) + 8 * has(Color::BLACK, Side::QUEEN_SIDE);
-        }
+    File getRookFile(Color color, Side castle) const { return rooks[color][static_cast<int>(castle)]; }
 
-        bool isEmpty() const { return !has(Color::WHITE) && !has(Color::BLACK); }
+    int hashIndex() const {
+        return has(Color::WHITE, Side::KING_SIDE) + 2 * has(Color::WHITE, Side::QUEEN_SIDE) +
+               4 * has(Color::BLACK, Side::KING_SIDE) + 8 * has(Color::BLACK, Side::QUEEN_SIDE);
+    }
 
-        template <typename T>
-        static constexpr Side closestSide(T sq, T pred) {
-            return sq > pred ? Side::KING_SIDE : Side::QUEEN_SIDE;
-        }
+    bool isEmpty() const { return !has(Color::WHITE) && !has(Color::BLACK); }
 
-       private:
-        // [color][side]
-        std::array<std::array<File, 2>, 2> rooks;
-    };
+    template <typename T>
+    static constexpr Side closestSide(T sq, T pred) {
+        return sq > pred ? Side::KING_SIDE : Side::QUEEN_SIDE;
+    }
 
    private:
+    // [color][side]
+    std::array<std::array<File, 2>, 2> rooks;
+};
+
+/**
+ * @brief Board state and rules, with piece update hooks bound at compile time (CRTP).
+ * Derived may shadow placePiece, removePiece and setFen to keep extra state in sync
+ * (incremental eval, pawn key, ...); makeMove and unmakeMove call them through
+ * derived() so they are inlined rather than dispatched virtually.
+ */
+template <typename Derived>
+class BasicBoard {
+    using U64 = std::uint64_t;
+
+   public:
+    using CastlingRights = chess::CastlingRights;
+
+   protected:
     struct State {
         U64 hash;
         CastlingRights castling;
@@ -1824,20 +1933,20 @@ class Board {
     enum class PrivateCtor { CREATE };
 
     // private constructor to avoid initialization
-    Board(PrivateCtor) {}
+    BasicBoard(PrivateCtor) {}
 
    public:
-    explicit Board(std::string_view fen = constants::STARTPOS, bool chess960 = false) {
+    explicit BasicBoard(std::string_view fen = constants::STARTPOS, bool chess960 = false) {
         prev_states_.reserve(256);
         chess960_ = chess960;
         setFenInternal<true>(fen);
     }
 
-    virtual void setFen(std::string_view fen) { setFenInternal(fen); }
+    void setFen(std::string_view fen) { setFenInternal(fen); }
 
-    static Board fromFen(std::string_view fen) { return Board(fen); }
-    static Board fromEpd(std::string_view epd) {
-        Board board;
+    static Derived fromFen(std::string_view fen) { return Derived(fen); }
+    static Derived fromEpd(std::string_view epd) {
+        Derived board;
         board.setEpd(epd);
         return board;
     }
@@ -1886,7 +1995,7 @@ class Board {
         auto fen = std::string(parts[0]) + " " + std::string(parts[1]) + " " + std::string(parts[2]) + " " +
                    std::string(parts[3]) + " " + std::to_string(hm) + " " + std::to_string(fm);
 
-        setFen(fen);
+        derived().setFen(fen);
     }
 
     /**
@@ -2007,7 +2116,7 @@ class Board {
         ep_sq_ = Square::underlying::NO_SQ;
 
         if (capture) {
-            removePiece(captured, move.to());
+            derived().removePiece(captured, move.to());
 
             hfm_ = 0;
             key_ ^= Zobrist::piece(captured, move.to());
@@ -2096,14 +2205,14 @@ class Board {
             const auto king = at(move.from());
             const auto rook = at(move.to());
 
-            removePiece(king, move.from());
-            removePiece(rook, move.to());
+            derived().removePiece(king, move.from());
+            derived().removePiece(rook, move.to());
 
             assert(king == Piece(PieceType::KING, stm_));
             assert(rook == Piece(PieceType::ROOK, stm_));
 
-            placePiece(king, kingTo);
-            placePiece(rook, rookTo);
+            derived().placePiece(king, kingTo);
+            derived().placePiece(rook, rookTo);
 
             key_ ^= Zobrist::piece(king, move.from()) ^ Zobrist::piece(king, kingTo);
             key_ ^= Zobrist::piece(rook, move.to()) ^ Zobrist::piece(rook, rookTo);
@@ -2111,8 +2220,8 @@ class Board {
             const auto piece_pawn = Piece(PieceType::PAWN, stm_);
             const auto piece_prom = Piece(move.promotionType(), stm_);
 
-            removePiece(piece_pawn, move.from());
-            placePiece(piece_prom, move.to());
+            derived().removePiece(piece_pawn, move.from());
+            derived().placePiece(piece_prom, move.to());
 
             key_ ^= Zobrist::piece(piece_pawn, move.from()) ^ Zobrist::piece(piece_prom, move.to());
         } else {
@@ -2121,8 +2230,8 @@ class Board {
 
             const auto piece = at(move.from());
 
-            removePiece(piece, move.from());
-            placePiece(piece, move.to());
+            derived().removePiece(piece, move.from());
+            derived().placePiece(piece, move.to());
 
             key_ ^= Zobrist::piece(piece, move.from()) ^ Zobrist::piece(piece, move.to());
         }
@@ -2132,7 +2241,7 @@ class Board {
 
             const auto piece = Piece(PieceType::PAWN, ~stm_);
 
-            removePiece(piece, move.to().ep_square());
+            derived().removePiece(piece, move.to().ep_square());
 
             key_ ^= Zobrist::piece(piece, move.to().ep_square());
         }
@@ -2162,14 +2271,14 @@ class Board {
             const auto rook = at(rook_from_sq);
             const auto king = at(king_to_sq);
 
-            removePiece(rook, rook_from_sq);
-            removePiece(king, king_to_sq);
+            derived().removePiece(rook, rook_from_sq);
+            derived().removePiece(king, king_to_sq);
 
             assert(king == Piece(PieceType::KING, stm_));
             assert(rook == Piece(PieceType::ROOK, stm_));
 
-            placePiece(king, move.from());
-            placePiece(rook, move.to());
+            derived().placePiece(king, move.from());
+            derived().placePiece(rook, move.to());
 
             key_ = prev.hash;
 
@@ -2183,12 +2292,12 @@ class Board {
             assert(piece.type() != PieceType::KING);
             assert(piece.type() != PieceType::NONE);
 
-            removePiece(piece, move.to());
-            placePiece(pawn, move.from());
+            derived().removePiece(piece, move.to());
+            derived().placePiece(pawn, move.from());
 
             if (prev.captured_piece != Piece::NONE) {
                 assert(at(move.to()) == Piece::NONE);
-                placePiece(prev.captured_piece, move.to());
+                derived().placePiece(prev.captured_piece, move.to());
             }
 
             key_ = prev.hash;
@@ -2199,8 +2308,8 @@ class Board {
 
             const auto piece = at(move.to());
 
-            removePiece(piece, move.to());
-            placePiece(piece, move.from());
+            derived().removePiece(piece, move.to());
+            derived().placePiece(piece, move.from());
         }
 
         if (move.typeOf() == Move::ENPASSANT) {
@@ -2209,11 +2318,11 @@ class Board {
 
             assert(at(pawnTo) == Piece::NONE);
 
-            placePiece(pawn, pawnTo);
+            derived().placePiece(pawn, pawnTo);
         } else if (prev.captured_piece != Piece::NONE) {
             assert(at(move.to()) == Piece::NONE);
 
-            placePiece(prev.captured_piece, move.to());
+            derived().placePiece(prev.captured_piece, move.to());
         }
 
         key_ = prev.hash;
@@ -2345,7 +2454,7 @@ class Board {
 
     void set960(bool is960) {
         chess960_ = is960;
-        if (!original_fen_.empty()) setFen(original_fen_);
+        if (!original_fen_.empty()) derived().setFen(original_fen_);
     }
 
     /**
@@ -2517,6 +2626,39 @@ class Board {
      */
     [[nodiscard]] bool inCheck() const { return isAttacked(kingSq(stm_), ~stm_); }
 
+    /**
+     * @brief Checks if a legal move gives check, without making it.
+     * When testing several moves of the same position, compute movegen::checkInfo() once instead.
+     * @param move
+     * @return
+     */
+    [[nodiscard]] bool givesCheck(const Move move) const {
+        return movegen::givesCheck(*this, move, movegen::checkInfo(*this));
+    }
+
+    [[nodiscard]] bool givesCheck(const Move move, const movegen::CheckInfo &info) const {
+        return movegen::givesCheck(*this, move, info);
+    }
+
+    /**
+     * @brief Checks if a move from elsewhere (killer, hash move) is pseudo-legal here.
+     * See movegen::isPseudoLegal.
+     * @param move
+     * @return
+     */
+    [[nodiscard]] bool isPseudoLegal(const Move move) const { return movegen::isPseudoLegal(*this, move); }
+
+    /**
+     * @brief Checks if a pseudo-legal move does not leave the own king in check.
+     * @param move
+     * @return
+     */
+    [[nodiscard]] bool isLegal(const Move move) const { return movegen::isLegal(*this, move); }
+
+    [[nodiscard]] bool isLegal(const Move move, const movegen::NodeInfo &info) const {
+        return movegen::isLegal(*this, move, info);
+    }
+
     /**
      * @brief Checks if the given color has at least 1 piece thats not pawn and not king
      * @param color
@@ -2559,125 +2701,378 @@ class Board {
         return hash_key ^ ep_hash ^ stm_hash ^ castling_hash;
     }
 
-    friend std::ostream &operator<<(std::ostream &os, const Board &board);
-
-    /**
-     * @brief Compresses the board into a PackedBoard.
-     */
-    class Compact {
-        friend class Board;
-        Compact() = default;
 
-       public:
-        /**
-         * @brief Compresses the board into a PackedBoard
-         * @param board
-         * @return
-         */
-        static PackedBoard encode(const Board &board) { return encodeState(board); }
+   protected:
+    void placePiece(Piece piece, Square sq) { placePieceInternal(piece, sq); }
 
-        static PackedBoard encode(std::string_view fen, bool chess960 = false) { return encodeState(fen, chess960); }
+    void removePiece(Piece piece, Square sq) { removePieceInternal(piece, sq); }
 
-        /**
-         * @brief Creates a Board object from a PackedBoard
-         * @param compressed
-         * @param chess960 If the board is a chess960 position, set this to true
-         * @return
-         */
-        static Board decode(const PackedBoard &compressed, bool chess960 = false) {
-            Board board     = Board(PrivateCtor::CREATE);
-            board.chess960_ = chess960;
-            decode(board, compressed);
-            return board;
-        }
+    std::vector<State> prev_states_;
 
-       private:
-        /**
-         * A compact board representation can be achieved in 24 bytes,
-         * we use 8 bytes (64bit) to store the occupancy bitboard,
-         * and 16 bytes (128bit) to store the pieces (plus some special information).
-         *
-         * Each of the 16 bytes can store 2 pieces, since chess only has 12 different pieces,
-         * we can represent the pieces from 0 to 11 in 4 bits (a nibble) and use the other 4 bit for
-         * the next piece.
-         * Since we need to store information about enpassant, castling rights and the side to move,
-         * we can use the remaining 4 bits to store this information.
-         *
-         * However we need to store the information and the piece information together.
-         * This means in our case that
-         * 12 -> enpassant + a pawn, we can deduce the color of the pawn from the rank of the square
-         * 13 -> white rook with castling rights, we later use the file to deduce if it's a short or long castle
-         * 14 -> black rook with castling rights, we later use the file to deduce if it's a short or long castle
-         * 15 -> black king and black is side to move
-         *
-         * We will later deduce the square of the pieces from the occupancy bitboard.
-         */
-        static PackedBoard encodeState(const Board &board) {
-            PackedBoard packed{};
+    std::array<Bitboard, 6> pieces_bb_ = {};
+    std::array<Bitboard, 2> occ_bb_    = {};
+    std::array<Piece, 64> board_       = {};
 
-            packed[0] = board.occ().getBits() >> 56;
-            packed[1] = (board.occ().getBits() >> 48) & 0xFF;
-            packed[2] = (board.occ().getBits() >> 40) & 0xFF;
-            packed[3] = (board.occ().getBits() >> 32) & 0xFF;
-            packed[4] = (board.occ().getBits() >> 24) & 0xFF;
-            packed[5] = (board.occ().getBits() >> 16) & 0xFF;
-            packed[6] = (board.occ().getBits() >> 8) & 0xFF;
-            packed[7] = board.occ().getBits() & 0xFF;
+    U64 key_           = 0ULL;
+    CastlingRights cr_ = {};
+    uint16_t plies_    = 0;
+    Color stm_         = Color::WHITE;
+    Square ep_sq_      = Square::underlying::NO_SQ;
+    uint8_t hfm_       = 0;
 
-            auto offset = 8 * 2;
-            auto occ    = board.occ();
+    bool chess960_ = false;
 
-            while (occ) {
-                // we now fill the packed array, since our convertedpiece only actually needs 4 bits,
-                // we can store 2 pieces in one byte.
-                const auto sq      = Square(occ.pop());
-                const auto shift   = (offset % 2 == 0 ? 4 : 0);
-                const auto meaning = convertMeaning(board.cr_, board.sideToMove(), board.ep_sq_, sq, board.at(sq));
-                const auto nibble  = meaning << shift;
+    Derived &derived() { return static_cast<Derived &>(*this); }
 
-                packed[offset / 2] |= nibble;
-                offset++;
-            }
+    void removePieceInternal(Piece piece, Square sq) {
+        assert(board_[sq.index()] == piece && piece != Piece::NONE);
 
-            return packed;
-        }
+        auto type  = piece.type();
+        auto color = piece.color();
+        auto index = sq.index();
 
-        static PackedBoard encodeState(std::string_view fen, bool chess960 = false) {
-            // fallback to slower method
-            if (chess960) {
-                Board board = Board(fen, true);
-                return encodeState(board);
-            }
+        assert(type != PieceType::NONE);
+        assert(color != Color::NONE);
+        assert(index >= 0 && index < 64);
 
-            PackedBoard packed{};
+        pieces_bb_[type].clear(index);
+        occ_bb_[color].clear(index);
+        board_[index] = Piece::NONE;
+    }
 
-            while (fen[0] == ' ') fen.remove_prefix(1);
+    void placePieceInternal(Piece piece, Square sq) {
+        assert(board_[sq.index()] == Piece::NONE);
 
-            const auto params     = split_string_view<6>(fen);
-            const auto position   = params[0].has_value() ? *params[0] : "";
-            const auto move_right = params[1].has_value() ? *params[1] : "w";
-            const auto castling   = params[2].has_value() ? *params[2] : "-";
-            const auto en_passant = params[3].has_value() ? *params[3] : "-";
+        auto type  = piece.type();
+        auto color = piece.color();
+        auto index = sq.index();
 
-            const auto ep  = en_passant == "-" ? Square::underlying::NO_SQ : Square(en_passant);
-            const auto stm = (move_right == "w") ? Color::WHITE : Color::BLACK;
+        assert(type != PieceType::NONE);
+        assert(color != Color::NONE);
+        assert(index >= 0 && index < 64);
 
-            CastlingRights cr;
+        pieces_bb_[type].set(index);
+        occ_bb_[color].set(index);
+        board_[index] = piece;
+    }
 
-            for (char i : castling) {
-                if (i == '-') break;
+    template <bool ctor = false>
+    void setFenInternal(std::string_view fen) {
+        original_fen_ = fen;
 
-                const auto king_side  = CastlingRights::Side::KING_SIDE;
-                const auto queen_side = CastlingRights::Side::QUEEN_SIDE;
+        occ_bb_.fill(0ULL);
+        pieces_bb_.fill(0ULL);
+        board_.fill(Piece::NONE);
 
-                if (i == 'K') cr.setCastlingRight(Color::WHITE, king_side, File::FILE_H);
-                if (i == 'Q') cr.setCastlingRight(Color::WHITE, queen_side, File::FILE_A);
-                if (i == 'k') cr.setCastlingRight(Color::BLACK, king_side, File::FILE_H);
-                if (i == 'q') cr.setCastlingRight(Color::BLACK, queen_side, File::FILE_A);
+        // find leading whitespaces and remove them
+        while (fen[0] == ' ') fen.remove_prefix(1);
 
-                assert(i == 'K' || i == 'Q' || i == 'k' || i == 'q');
+        const auto params     = split_string_view<6>(fen);
+        const auto position   = params[0].has_value() ? *params[0] : "";
+        const auto move_right = params[1].has_value() ? *params[1] : "w";
+        const auto castling   = params[2].has_value() ? *params[2] : "-";
+        const auto en_passant = params[3].has_value() ? *params[3] : "-";
+        const auto half_move  = params[4].has_value() ? *params[4] : "0";
+        const auto full_move  = params[5].has_value() ? *params[5] : "1";
 
-                continue;
+        static auto parseStringViewToInt = [](std::string_view sv) -> std::optional<int> {
+            if (!sv.empty() && sv.back() == ';') sv.remove_suffix(1);
+#ifndef CHESS_NO_EXCEPTIONS
+            try {
+                size_t pos;
+                int value = std::stoi(std::string(sv), &pos);
+                if (pos == sv.size()) return value;
+            } catch (...) {
+            }
+#else
+            size_t pos;
+            int value = std::stoi(std::string(sv), &pos);
+            if (pos == sv.size()) return value;
+#endif
+            return std::nullopt;
+        };
+
+        // Half move clock
+        hfm_ = parseStringViewToInt(half_move).value_or(0);
+
+        // Full move number
+        plies_ = parseStringViewToInt(full_move).value_or(1);
+
+        plies_ = plies_ * 2 - 2;
+        ep_sq_ = en_passant == "-" ? Square::underlying::NO_SQ : Square(en_passant);
+        stm_   = (move_right == "w") ? Color::WHITE : Color::BLACK;
+        key_   = 0ULL;
+        cr_.clear();
+        prev_states_.clear();
+
+        if (stm_ == Color::BLACK) {
+            plies_++;
+        } else {
+            key_ ^= Zobrist::sideToMove();
+        }
+
+        auto square = 56;
+        for (char curr : position) {
+            if (isdigit(curr)) {
+                square += (curr - '0');
+            } else if (curr == '/') {
+                square -= 16;
+            } else {
+                auto p = Piece(std::string_view(&curr, 1));
+
+                // prevent warnings about virtual method bypassing virtual dispatch
+                if constexpr (ctor) {
+                    placePieceInternal(p, Square(square));
+                } else {
+                    derived().placePiece(p, square);
+                }
+
+                key_ ^= Zobrist::piece(p, Square(square));
+                ++square;
+            }
+        }
+
+        static const auto find_rook = [](const BasicBoard &board, CastlingRights::Side side, Color color) {
+            const auto king_side = CastlingRights::Side::KING_SIDE;
+            const auto king_sq   = board.kingSq(color);
+            const auto sq_corner = Square(side == king_side ? Square::underlying::SQ_H1 : Square::underlying::SQ_A1)
+                                       .relative_square(color);
+
+            const auto start = side == king_side ? king_sq + 1 : king_sq - 1;
+
+            for (Square sq = start; (side == king_side ? sq <= sq_corner : sq >= sq_corner);
+                 (side == king_side ? sq++ : sq--)) {
+                if (board.at<PieceType>(sq) == PieceType::ROOK && board.at(sq).color() == color) {
+                    return sq.file();
+                }
+            }
+
+#ifndef CHESS_NO_EXCEPTIONS
+            throw std::runtime_error("Invalid position");
+#endif
+
+            return File(File::NO_FILE);
+        };
+
+        for (char i : castling) {
+            if (i == '-') break;
+
+            const auto king_side  = CastlingRights::Side::KING_SIDE;
+            const auto queen_side = CastlingRights::Side::QUEEN_SIDE;
+
+            if (!chess960_) {
+                if (i == 'K') cr_.setCastlingRight(Color::WHITE, king_side, File::FILE_H);
+                if (i == 'Q') cr_.setCastlingRight(Color::WHITE, queen_side, File::FILE_A);
+                if (i == 'k') cr_.setCastlingRight(Color::BLACK, king_side, File::FILE_H);
+                if (i == 'q') cr_.setCastlingRight(Color::BLACK, queen_side, File::FILE_A);
+
+                continue;
+            }
+
+            // chess960 castling detection
+
+            const auto color   = isupper(i) ? Color::WHITE : Color::BLACK;
+            const auto king_sq = kingSq(color);
+
+            // find rook on the right side of the king
+            if (i == 'K' || i == 'k') {
+                cr_.setCastlingRight(color, king_side, find_rook(*this, king_side, color));
+            }
+            // find rook on the left side of the king
+            else if (i == 'Q' || i == 'q') {
+                cr_.setCastlingRight(color, queen_side, find_rook(*this, queen_side, color));
+            }
+            // correct frc castling encoding
+            else {
+                const auto file = File(std::string_view(&i, 1));
+                const auto side = CastlingRights::closestSide(file, king_sq.file());
+                cr_.setCastlingRight(color, side, file);
+            }
+        }
+
+        // check if ep square itself is valid
+        if (ep_sq_ != Square::underlying::NO_SQ && !((ep_sq_.rank() == Rank::RANK_3 && stm_ == Color::BLACK) ||
+                                                     (ep_sq_.rank() == Rank::RANK_6 && stm_ == Color::WHITE))) {
+            ep_sq_ = Square::underlying::NO_SQ;
+        }
+
+        // check if ep square is valid, i.e. if there is a pawn that can capture it
+        if (ep_sq_ != Square::underlying::NO_SQ) {
+            bool valid;
+
+            if (stm_ == Color::WHITE) {
+                valid = movegen::isEpSquareValid<Color::WHITE>(*this, ep_sq_);
+            } else {
+                valid = movegen::isEpSquareValid<Color::BLACK>(*this, ep_sq_);
+            }
+
+            if (!valid)
+                ep_sq_ = Square::underlying::NO_SQ;
+            else
+                key_ ^= Zobrist::enpassant(ep_sq_.file());
+        }
+
+        key_ ^= Zobrist::castling(cr_.hashIndex());
+
+        assert(key_ == zobrist());
+    }
+
+    template <int N>
+    std::array<std::optional<std::string_view>, N> static split_string_view(std::string_view fen,
+                                                                            char delimiter = ' ') {
+        std::array<std::optional<std::string_view>, N> arr = {};
+
+        std::size_t start = 0;
+        std::size_t end   = 0;
+
+        for (std::size_t i = 0; i < N; i++) {
+            end = fen.find(delimiter, start);
+            if (end == std::string::npos) {
+                arr[i] = fen.substr(start);
+                break;
+            }
+            arr[i] = fen.substr(start, end - start);
+            start  = end + 1;
+        }
+
+        return arr;
+    }
+
+    // store the original fen string
+    // useful when setting up a frc position and the user called set960(true) afterwards
+    std::string original_fen_;
+};
+
+/**
+ * @brief Board with the classic virtual interface. placePiece, removePiece and setFen can be
+ * overridden by subclasses as before, at the cost of an indirect call per piece update.
+ */
+class Board : public BasicBoard<Board> {
+   public:
+    explicit Board(std::string_view fen = constants::STARTPOS, bool chess960 = false)
+        : BasicBoard(fen, chess960) {}
+
+    virtual void setFen(std::string_view fen) { BasicBoard::setFen(fen); }
+
+    friend std::ostream &operator<<(std::ostream &os, const Board &board);
+
+    /**
+     * @brief Compresses the board into a PackedBoard.
+     */
+    class Compact {
+        friend class Board;
+        Compact() = default;
+
+       public:
+        /**
+         * @brief Compresses the board into a PackedBoard
+         * @param board
+         * @return
+         */
+        static PackedBoard encode(const Board &board) { return encodeState(board); }
+
+        static PackedBoard encode(std::string_view fen, bool chess960 = false) { return encodeState(fen, chess960); }
+
+        /**
+         * @brief Creates a Board object from a PackedBoard
+         * @param compressed
+         * @param chess960 If the board is a chess960 position, set this to true
+         * @return
+         */
+        static Board decode(const PackedBoard &compressed, bool chess960 = false) {
+            Board board     = Board(PrivateCtor::CREATE);
+            board.chess960_ = chess960;
+            decode(board, compressed);
+            return board;
+        }
+
+       private:
+        /**
+         * A compact board representation can be achieved in 24 bytes,
+         * we use 8 bytes (64bit) to store the occupancy bitboard,
+         * and 16 bytes (128bit) to store the pieces (plus some special information).
+         *
+         * Each of the 16 bytes can store 2 pieces, since chess only has 12 different pieces,
+         * we can represent the pieces from 0 to 11 in 4 bits (a nibble) and use the other 4 bit for
+         * the next piece.
+         * Since we need to store information about enpassant, castling rights and the side to move,
+         * we can use the remaining 4 bits to store this information.
+         *
+         * However we need to store the information and the piece information together.
+         * This means in our case that
+         * 12 -> enpassant + a pawn, we can deduce the color of the pawn from the rank of the square
+         * 13 -> white rook with castling rights, we later use the file to deduce if it's a short or long castle
+         * 14 -> black rook with castling rights, we later use the file to deduce if it's a short or long castle
+         * 15 -> black king and black is side to move
+         *
+         * We will later deduce the square of the pieces from the occupancy bitboard.
+         */
+        static PackedBoard encodeState(const Board &board) {
+            PackedBoard packed{};
+
+            packed[0] = board.occ().getBits() >> 56;
+            packed[1] = (board.occ().getBits() >> 48) & 0xFF;
+            packed[2] = (board.occ().getBits() >> 40) & 0xFF;
+            packed[3] = (board.occ().getBits() >> 32) & 0xFF;
+            packed[4] = (board.occ().getBits() >> 24) & 0xFF;
+            packed[5] = (board.occ().getBits() >> 16) & 0xFF;
+            packed[6] = (board.occ().getBits() >> 8) & 0xFF;
+            packed[7] = board.occ().getBits() & 0xFF;
+
+            auto offset = 8 * 2;
+            auto occ    = board.occ();
+
+            while (occ) {
+                // we now fill the packed array, since our convertedpiece only actually needs 4 bits,
+                // we can store 2 pieces in one byte.
+                const auto sq      = Square(occ.pop());
+                const auto shift   = (offset % 2 == 0 ? 4 : 0);
+                const auto meaning = convertMeaning(board.cr_, board.sideToMove(), board.ep_sq_, sq, board.at(sq));
+                const auto nibble  = meaning << shift;
+
+                packed[offset / 2] |= nibble;
+                offset++;
+            }
+
+            return packed;
+        }
+
+        static PackedBoard encodeState(std::string_view fen, bool chess960 = false) {
+            // fallback to slower method
+            if (chess960) {
+                Board board = Board(fen, true);
+                return encodeState(board);
+            }
+
+            PackedBoard packed{};
+
+            while (fen[0] == ' ') fen.remove_prefix(1);
+
+            const auto params     = split_string_view<6>(fen);
+            const auto position   = params[0].has_value() ? *params[0] : "";
+            const auto move_right = params[1].has_value() ? *params[1] : "w";
+            const auto castling   = params[2].has_value() ? *params[2] : "-";
+            const auto en_passant = params[3].has_value() ? *params[3] : "-";
+
+            const auto ep  = en_passant == "-" ? Square::underlying::NO_SQ : Square(en_passant);
+            const auto stm = (move_right == "w") ? Color::WHITE : Color::BLACK;
+
+            CastlingRights cr;
+
+            for (char i : castling) {
+                if (i == '-') break;
+
+                const auto king_side  = CastlingRights::Side::KING_SIDE;
+                const auto queen_side = CastlingRights::Side::QUEEN_SIDE;
+
+                if (i == 'K') cr.setCastlingRight(Color::WHITE, king_side, File::FILE_H);
+                if (i == 'Q') cr.setCastlingRight(Color::WHITE, queen_side, File::FILE_A);
+                if (i == 'k') cr.setCastlingRight(Color::BLACK, king_side, File::FILE_H);
+                if (i == 'q') cr.setCastlingRight(Color::BLACK, queen_side, File::FILE_A);
+
+                assert(i == 'K' || i == 'Q' || i == 'k' || i == 'q');
+
+                continue;
             }
 
             const auto parts = split_string_view<8>(position, '/');
@@ -2811,284 +3206,63 @@ class Board {
                 board.plies_++;
             }
 
-            board.key_ = board.zobrist();
-        }
-
-        // 1:1 mapping of Piece::internal() to the compressed piece
-        static std::uint8_t convertPiece(Piece piece) { return int(piece.internal()); }
-
-        // for pieces with a special meaning return Piece::NONE since this is otherwise not used
-        static Piece convertPiece(std::uint8_t piece) {
-            if (piece >= 12) return Piece::NONE;
-            return Piece(Piece::underlying(piece));
-        }
-
-        // 12 => theres an ep square behind the pawn, rank will be deduced from the rank
-        // 13 => any white rook with castling rights, side will be deduced from the file
-        // 14 => any black rook with castling rights, side will be deduced from the file
-        // 15 => black king and black is side to move
-        static std::uint8_t convertMeaning(const CastlingRights &cr, Color stm, Square ep, Square sq, Piece piece) {
-            if (piece.type() == PieceType::PAWN && ep != Square::underlying::NO_SQ) {
-                if (Square(static_cast<int>(sq.index()) ^ 8) == ep) return 12;
-            }
-
-            if (piece.type() == PieceType::ROOK) {
-                if (piece.color() == Color::WHITE && Square::back_rank(sq, Color::WHITE) &&
-                    (cr.getRookFile(Color::WHITE, CastlingRights::Side::KING_SIDE) == sq.file() ||
-                     cr.getRookFile(Color::WHITE, CastlingRights::Side::QUEEN_SIDE) == sq.file()))
-                    return 13;
-                if (piece.color() == Color::BLACK && Square::back_rank(sq, Color::BLACK) &&
-                    (cr.getRookFile(Color::BLACK, CastlingRights::Side::KING_SIDE) == sq.file() ||
-                     cr.getRookFile(Color::BLACK, CastlingRights::Side::QUEEN_SIDE) == sq.file()))
-                    return 14;
-            }
-
-            if (piece.type() == PieceType::KING && piece.color() == Color::BLACK && stm == Color::BLACK) {
-                return 15;
-            }
-
-            return convertPiece(piece);
-        }
-    };
-
-   protected:
-    virtual void placePiece(Piece piece, Square sq) { placePieceInternal(piece, sq); }
-
-    virtual void removePiece(Piece piece, Square sq) { removePieceInternal(piece, sq); }
-
-    std::vector<State> prev_states_;
-
-    std::array<Bitboard, 6> pieces_bb_ = {};
-    std::array<Bitboard, 2> occ_bb_    = {};
-    std::array<Piece, 64> board_       = {};
-
-    U64 key_           = 0ULL;
-    CastlingRights cr_ = {};
-    uint16_t plies_    = 0;
-    Color stm_         = Color::WHITE;
-    Square ep_sq_      = Square::underlying::NO_SQ;
-    uint8_t hfm_       = 0;
-
-    bool chess960_ = false;
-
-   private:
-    void removePieceInternal(Piece piece, Square sq) {
-        assert(board_[sq.index()] == piece && piece != Piece::NONE);
-
-        auto type  = piece.type();
-        auto color = piece.color();
-        auto index = sq.index();
-
-        assert(type != PieceType::NONE);
-        assert(color != Color::NONE);
-        assert(index >= 0 && index < 64);
-
-        pieces_bb_[type].clear(index);
-        occ_bb_[color].clear(index);
-        board_[index] = Piece::NONE;
-    }
-
-    void placePieceInternal(Piece piece, Square sq) {
-        assert(board_[sq.index()] == Piece::NONE);
-
-        auto type  = piece.type();
-        auto color = piece.color();
-        auto index = sq.index();
-
-        assert(type != PieceType::NONE);
-        assert(color != Color::NONE);
-        assert(index >= 0 && index < 64);
-
-        pieces_bb_[type].set(index);
-        occ_bb_[color].set(index);
-        board_[index] = piece;
-    }
-
-    template <bool ctor = false>
-    void setFenInternal(std::string_view fen) {
-        original_fen_ = fen;
-
-        occ_bb_.fill(0ULL);
-        pieces_bb_.fill(0ULL);
-        board_.fill(Piece::NONE);
-
-        // find leading whitespaces and remove them
-        while (fen[0] == ' ') fen.remove_prefix(1);
-
-        const auto params     = split_string_view<6>(fen);
-        const auto position   = params[0].has_value() ? *params[0] : "";
-        const auto move_right = params[1].has_value() ? *params[1] : "w";
-        const auto castling   = params[2].has_value() ? *params[2] : "-";
-        const auto en_passant = params[3].has_value() ? *params[3] : "-";
-        const auto half_move  = params[4].has_value() ? *params[4] : "0";
-        const auto full_move  = params[5].has_value() ? *params[5] : "1";
-
-        static auto parseStringViewToInt = [](std::string_view sv) -> std::optional<int> {
-            if (!sv.empty() && sv.back() == ';') sv.remove_suffix(1);
-#ifndef CHESS_NO_EXCEPTIONS
-            try {
-                size_t pos;
-                int value = std::stoi(std::string(sv), &pos);
-                if (pos == sv.size()) return value;
-            } catch (...) {
-            }
-#else
-            size_t pos;
-            int value = std::stoi(std::string(sv), &pos);
-            if (pos == sv.size()) return value;
-#endif
-            return std::nullopt;
-        };
-
-        // Half move clock
-        hfm_ = parseStringViewToInt(half_move).value_or(0);
-
-        // Full move number
-        plies_ = parseStringViewToInt(full_move).value_or(1);
-
-        plies_ = plies_ * 2 - 2;
-        ep_sq_ = en_passant == "-" ? Square::underlying::NO_SQ : Square(en_passant);
-        stm_   = (move_right == "w") ? Color::WHITE : Color::BLACK;
-        key_   = 0ULL;
-        cr_.clear();
-        prev_states_.clear();
-
-        if (stm_ == Color::BLACK) {
-            plies_++;
-        } else {
-            key_ ^= Zobrist::sideToMove();
-        }
-
-        auto square = 56;
-        for (char curr : position) {
-            if (isdigit(curr)) {
-                square += (curr - '0');
-            } else if (curr == '/') {
-                square -= 16;
-            } else {
-                auto p = Piece(std::string_view(&curr, 1));
-
-                // prevent warnings about virtual method bypassing virtual dispatch
-                if constexpr (ctor) {
-                    placePieceInternal(p, Square(square));
-                } else {
-                    placePiece(p, square);
-                }
-
-                key_ ^= Zobrist::piece(p, Square(square));
-                ++square;
-            }
-        }
-
-        static const auto find_rook = [](const Board &board, CastlingRights::Side side, Color color) {
-            const auto king_side = CastlingRights::Side::KING_SIDE;
-            const auto king_sq   = board.kingSq(color);
-            const auto sq_corner = Square(side == king_side ? Square::underlying::SQ_H1 : Square::underlying::SQ_A1)
-                                       .relative_square(color);
-
-            const auto start = side == king_side ? king_sq + 1 : king_sq - 1;
-
-            for (Square sq = start; (side == king_side ? sq <= sq_corner : sq >= sq_corner);
-                 (side == king_side ? sq++ : sq--)) {
-                if (board.at<PieceType>(sq) == PieceType::ROOK && board.at(sq).color() == color) {
-                    return sq.file();
-                }
-            }
-
-#ifndef CHESS_NO_EXCEPTIONS
-            throw std::runtime_error("Invalid position");
-#endif
-
-            return File(File::NO_FILE);
-        };
-
-        for (char i : castling) {
-            if (i == '-') break;
-
-            const auto king_side  = CastlingRights::Side::KING_SIDE;
-            const auto queen_side = CastlingRights::Side::QUEEN_SIDE;
-
-            if (!chess960_) {
-                if (i == 'K') cr_.setCastlingRight(Color::WHITE, king_side, File::FILE_H);
-                if (i == 'Q') cr_.setCastlingRight(Color::WHITE, queen_side, File::FILE_A);
-                if (i == 'k') cr_.setCastlingRight(Color::BLACK, king_side, File::FILE_H);
-                if (i == 'q') cr_.setCastlingRight(Color::BLACK, queen_side, File::FILE_A);
-
-                continue;
-            }
-
-            // chess960 castling detection
-
-            const auto color   = isupper(i) ? Color::WHITE : Color::BLACK;
-            const auto king_sq = kingSq(color);
-
-            // find rook on the right side of the king
-            if (i == 'K' || i == 'k') {
-                cr_.setCastlingRight(color, king_side, find_rook(*this, king_side, color));
-            }
-            // find rook on the left side of the king
-            else if (i == 'Q' || i == 'q') {
-                cr_.setCastlingRight(color, queen_side, find_rook(*this, queen_side, color));
-            }
-            // correct frc castling encoding
-            else {
-                const auto file = File(std::string_view(&i, 1));
-                const auto side = CastlingRights::closestSide(file, king_sq.file());
-                cr_.setCastlingRight(color, side, file);
-            }
-        }
-
-        // check if ep square itself is valid
-        if (ep_sq_ != Square::underlying::NO_SQ && !((ep_sq_.rank() == Rank::RANK_3 && stm_ == Color::BLACK) ||
-                                                     (ep_sq_.rank() == Rank::RANK_6 && stm_ == Color::WHITE))) {
-            ep_sq_ = Square::underlying::NO_SQ;
-        }
-
-        // check if ep square is valid, i.e. if there is a pawn that can capture it
-        if (ep_sq_ != Square::underlying::NO_SQ) {
-            bool valid;
-
-            if (stm_ == Color::WHITE) {
-                valid = movegen::isEpSquareValid<Color::WHITE>(*this, ep_sq_);
-            } else {
-                valid = movegen::isEpSquareValid<Color::BLACK>(*this, ep_sq_);
-            }
-
-            if (!valid)
-                ep_sq_ = Square::underlying::NO_SQ;
-            else
-                key_ ^= Zobrist::enpassant(ep_sq_.file());
+            board.key_ = board.zobrist();
         }
 
-        key_ ^= Zobrist::castling(cr_.hashIndex());
+        // 1:1 mapping of Piece::internal() to the compressed piece
+        static std::uint8_t convertPiece(Piece piece) { return int(piece.internal()); }
 
-        assert(key_ == zobrist());
-    }
+        // for pieces with a special meaning return Piece::NONE since this is otherwise not used
+        static Piece convertPiece(std::uint8_t piece) {
+            if (piece >= 12) return Piece::NONE;
+            return Piece(Piece::underlying(piece));
+        }
 
-    template <int N>
-    std::array<std::optional<std::string_view>, N> static split_string_view(std::string_view fen,
-                                                                            char delimiter = ' ') {
-        std::array<std::optional<std::string_view>, N> arr = {};
+        // 12 => theres an ep square behind the pawn, rank will be deduced from the rank
+        // 13 => any white rook with castling rights, side will be deduced from the file
+        // 14 => any black rook with castling rights, side will be deduced from the file
+        // 15 => black king and black is side to move
+        static std::uint8_t convertMeaning(const CastlingRights &cr, Color stm, Square ep, Square sq, Piece piece) {
+            if (piece.type() == PieceType::PAWN && ep != Square::underlying::NO_SQ) {
+                if (Square(static_cast<int>(sq.index()) ^ 8) == ep) return 12;
+            }
 
-        std::size_t start = 0;
-        std::size_t end   = 0;
+            if (piece.type() == PieceType::ROOK) {
+                if (piece.color() == Color::WHITE && Square::back_rank(sq, Color::WHITE) &&
+                    (cr.getRookFile(Color::WHITE, CastlingRights::Side::KING_SIDE) == sq.file() ||
+                     cr.getRookFile(Color::WHITE, CastlingRights::Side::QUEEN_SIDE) == sq.file()))
+                    return 13;
+                if (piece.color() == Color::BLACK && Square::back_rank(sq, Color::BLACK) &&
+                    (cr.getRookFile(Color::BLACK, CastlingRights::Side::KING_SIDE) == sq.file() ||
+                     cr.getRookFile(Color::BLACK, CastlingRights::Side::QUEEN_SIDE) == sq.file()))
+                    return 14;
+            }
 
-        for (std::size_t i = 0; i < N; i++) {
-            end = fen.find(delimiter, start);
-            if (end == std::string::npos) {
-                arr[i] = fen.substr(start);
-                break;
+            if (piece.type() == PieceType::KING && piece.color() == Color::BLACK && stm == Color::BLACK) {
+                return 15;
             }
-            arr[i] = fen.substr(start, end - start);
-            start  = end + 1;
+
+            return convertPiece(piece);
         }
+    };
 
-        return arr;
-    }
+   protected:
+    virtual void placePiece(Piece piece, Square sq) { placePieceInternal(piece, sq); }
 
-    // store the original fen string
-    // useful when setting up a frc position and the user called set960(true) afterwards
-    std::string original_fen_;
+    virtual void removePiece(Piece piece, Square sq) { removePieceInternal(piece, sq); }
+
+   private:
+    Board(PrivateCtor) : BasicBoard(PrivateCtor::CREATE) {}
+
+    friend class BasicBoard<Board>;
+};
+
+/**
+ * @brief Board without hooks. Every call is resolved at compile time, and copies carry no vptr.
+ */
+class PlainBoard final : public BasicBoard<PlainBoard> {
+   public:
+    using BasicBoard::BasicBoard;
 };
 
 inline std::ostream &operator<<(std::ostream &os, const Board &b) {
@@ -3320,8 +3494,8 @@ inline auto movegen::init_squares_between() {
     return squares_between_bb;
 }
 
-template <Color::underlying c>
-[[nodiscard]] inline std::pair<Bitboard, int> movegen::checkMask(const Board &board, Square sq) {
+template <Color::underlying c, typename BoardT>
+[[nodiscard]] inline std::pair<Bitboard, int> movegen::checkMask(const BoardT &board, Square sq) {
     const auto opp_knight = board.pieces(PieceType::KNIGHT, ~c);
     const auto opp_bishop = board.pieces(PieceType::BISHOP, ~c);
     const auto opp_rook   = board.pieces(PieceType::ROOK, ~c);
@@ -3355,7 +3529,7 @@ template <Color::underlying c>
     Bitboard rook_attacks = attacks::rook(sq, board.occ()) & (opp_rook | opp_queen);
 
     if (rook_attacks) {
-        if (rook_attacks.count() > 1) {
+        if (rook_attacks.moreThanOne()) {
             checks = 2;
             return {mask, checks};
         }
@@ -3373,8 +3547,8 @@ template <Color::underlying c>
     return {mask, checks};
 }
 
-template <Color::underlying c>
-[[nodiscard]] inline Bitboard movegen::pinMaskRooks(const Board &board, Square sq, Bitboard occ_opp, Bitboard occ_us) {
+template <Color::underlying c, typename BoardT>
+[[nodiscard]] inline Bitboard movegen::pinMaskRooks(const BoardT &board, Square sq, Bitboard occ_opp, Bitboard occ_us) {
     const auto opp_rook  = board.pieces(PieceType::ROOK, ~c);
     const auto opp_queen = board.pieces(PieceType::QUEEN, ~c);
 
@@ -3385,14 +3559,15 @@ template <Color::underlying c>
         const auto index = rook_attacks.pop();
 
         const Bitboard possible_pin = SQUARES_BETWEEN_BB[sq.index()][index] | Bitboard::fromSquare(index);
-        if ((possible_pin & occ_us).count() == 1) pin_hv |= possible_pin;
+        const auto blockers = possible_pin & occ_us;
+        if (blockers && !blockers.moreThanOne()) pin_hv |= possible_pin;
     }
 
     return pin_hv;
 }
 
-template <Color::underlying c>
-[[nodiscard]] inline Bitboard movegen::pinMaskBishops(const Board &board, Square sq, Bitboard occ_opp,
+template <Color::underlying c, typename BoardT>
+[[nodiscard]] inline Bitboard movegen::pinMaskBishops(const BoardT &board, Square sq, Bitboard occ_opp,
                                                       Bitboard occ_us) {
     const auto opp_bishop = board.pieces(PieceType::BISHOP, ~c);
     const auto opp_queen  = board.pieces(PieceType::QUEEN, ~c);
@@ -3404,14 +3579,15 @@ template <Color::underlying c>
         const auto index = bishop_attacks.pop();
 
         const Bitboard possible_pin = SQUARES_BETWEEN_BB[sq.index()][index] | Bitboard::fromSquare(index);
-        if ((possible_pin & occ_us).count() == 1) pin_diag |= possible_pin;
+        const auto blockers = possible_pin & occ_us;
+        if (blockers && !blockers.moreThanOne()) pin_diag |= possible_pin;
     }
 
     return pin_diag;
 }
 
-template <Color::underlying c>
-[[nodiscard]] inline Bitboard movegen::seenSquares(const Board &board, Bitboard enemy_empty) {
+template <Color::underlying c, typename BoardT>
+[[nodiscard]] inline Bitboard movegen::seenSquares(const BoardT &board, Bitboard enemy_empty) {
     auto king_sq          = board.kingSq(~c);
     Bitboard map_king_atk = attacks::king(king_sq) & enemy_empty;
 
@@ -3449,8 +3625,8 @@ template <Color::underlying c>
     return seen;
 }
 
-template <Color::underlying c, movegen::MoveGenType mt>
-inline void movegen::generatePawnMoves(const Board &board, Movelist &moves, Bitboard pin_d, Bitboard pin_hv,
+template <Color::underlying c, movegen::MoveGenType mt, typename BoardT>
+inline void movegen::generatePawnMoves(const BoardT &board, Movelist &moves, Bitboard pin_d, Bitboard pin_hv,
                                        Bitboard checkmask, Bitboard occ_opp) {
     // flipped for black
 
@@ -3569,7 +3745,8 @@ inline void movegen::generatePawnMoves(const Board &board, Movelist &moves, Bitb
     }
 }
 
-[[nodiscard]] inline std::array<Move, 2> movegen::generateEPMove(const Board &board, Bitboard checkmask, Bitboard pin_d,
+template <typename BoardT>
+[[nodiscard]] inline std::array<Move, 2> movegen::generateEPMove(const BoardT &board, Bitboard checkmask, Bitboard pin_d,
                                                                  Bitboard pawns_lr, Square ep, Color c) {
     assert((ep.rank() == Rank::RANK_3 && board.sideToMove() == Color::BLACK) ||
            (ep.rank() == Rank::RANK_6 && board.sideToMove() == Color::WHITE));
@@ -3659,8 +3836,8 @@ inline void movegen::generatePawnMoves(const Board &board, Movelist &moves, Bitb
     return attacks::king(sq) & movable_square & ~seen;
 }
 
-template <Color::underlying c, movegen::MoveGenType mt>
-[[nodiscard]] inline Bitboard movegen::generateCastleMoves(const Board &board, Square sq, Bitboard seen,
+template <Color::underlying c, movegen::MoveGenType mt, typename BoardT>
+[[nodiscard]] inline Bitboard movegen::generateCastleMoves(const BoardT &board, Square sq, Bitboard seen,
                                                            Bitboard pin_hv) {
     if constexpr (mt == MoveGenType::CAPTURE) return 0ull;
     if (!Square::back_rank(sq, c) || !board.castlingRights().has(c)) return 0ull;
@@ -3669,11 +3846,11 @@ template <Color::underlying c, movegen::MoveGenType mt>
 
     Bitboard moves = 0ull;
 
-    for (const auto side : {Board::CastlingRights::Side::KING_SIDE, Board::CastlingRights::Side::QUEEN_SIDE}) {
+    for (const auto side : {CastlingRights::Side::KING_SIDE, CastlingRights::Side::QUEEN_SIDE}) {
         if (!rights.has(c, side)) continue;
 
-        const auto end_king_sq = Square::castling_king_square(side == Board::CastlingRights::Side::KING_SIDE, c);
-        const auto end_rook_sq = Square::castling_rook_square(side == Board::CastlingRights::Side::KING_SIDE, c);
+        const auto end_king_sq = Square::castling_king_square(side == CastlingRights::Side::KING_SIDE, c);
+        const auto end_rook_sq = Square::castling_rook_square(side == CastlingRights::Side::KING_SIDE, c);
 
         const auto from_rook_sq = Square(rights.getRookFile(c, side), sq.rank());
 
@@ -3708,8 +3885,28 @@ inline void movegen::whileBitboardAdd(Movelist &movelist, Bitboard mask, T func)
     }
 }
 
-template <Color::underlying c, movegen::MoveGenType mt>
-inline void movegen::legalmoves(Movelist &movelist, const Board &board, int pieces) {
+template <Color::underlying c, typename BoardT>
+[[nodiscard]] CHESS_CPU_DISPATCH inline movegen::NodeInfo movegen::nodeInfo(const BoardT &board) {
+    const auto king_sq = board.kingSq(c);
+    const auto occ_us  = board.us(c);
+    const auto occ_opp = board.us(~c);
+
+    NodeInfo info;
+    std::tie(info.checkmask, info.checks) = checkMask<c>(board, king_sq);
+    info.pin_hv = pinMaskRooks<c>(board, king_sq, occ_opp, occ_us);
+    info.pin_d  = pinMaskBishops<c>(board, king_sq, occ_opp, occ_us);
+    info.seen   = seenSquares<~c>(board, ~occ_us);
+    return info;
+}
+
+template <typename BoardT>
+[[nodiscard]] inline movegen::NodeInfo movegen::nodeInfo(const BoardT &board) {
+    if (board.sideToMove() == Color::WHITE) return nodeInfo<Color::WHITE>(board);
+    return nodeInfo<Color::BLACK>(board);
+}
+
+template <Color::underlying c, movegen::MoveGenType mt, typename BoardT>
+inline void movegen::legalmoves(Movelist &movelist, const BoardT &board, const NodeInfo &info, int pieces) {
     /*
      The size of the movelist might not
      be 0! This is done on purpose since it enables
@@ -3723,9 +3920,10 @@ inline void movegen::legalmoves(Movelist &movelist, const Board &board, int piec
 
     Bitboard opp_empty = ~occ_us;
 
-    const auto [checkmask, checks] = checkMask<c>(board, king_sq);
-    const auto pin_hv              = pinMaskRooks<c>(board, king_sq, occ_opp, occ_us);
-    const auto pin_d               = pinMaskBishops<c>(board, king_sq, occ_opp, occ_us);
+    const auto checkmask = info.checkmask;
+    const auto checks    = info.checks;
+    const auto pin_hv    = info.pin_hv;
+    const auto pin_d     = info.pin_d;
 
     assert(checks <= 2);
 
@@ -3741,7 +3939,7 @@ inline void movegen::legalmoves(Movelist &movelist, const Board &board, int piec
         movable_square = ~occ_all;
 
     if (pieces & PieceGenType::KING) {
-        Bitboard seen = seenSquares<~c>(board, opp_empty);
+        const Bitboard seen = info.seen;
 
         whileBitboardAdd(movelist, Bitboard::fromSquare(king_sq),
                          [&](Square sq) { return generateKingMoves(sq, seen, movable_square); });
@@ -3798,18 +3996,28 @@ inline void movegen::legalmoves(Movelist &movelist, const Board &board, int piec
     }
 }
 
-template <movegen::MoveGenType mt>
-inline void movegen::legalmoves(Movelist &movelist, const Board &board, int pieces) {
+template <movegen::MoveGenType mt, typename BoardT>
+inline void movegen::legalmoves(Movelist &movelist, const BoardT &board, int pieces) {
     movelist.clear();
 
     if (board.sideToMove() == Color::WHITE)
-        legalmoves<Color::WHITE, mt>(movelist, board, pieces);
+        legalmoves<Color::WHITE, mt>(movelist, board, nodeInfo<Color::WHITE>(board), pieces);
     else
-        legalmoves<Color::BLACK, mt>(movelist, board, pieces);
+        legalmoves<Color::BLACK, mt>(movelist, board, nodeInfo<Color::BLACK>(board), pieces);
 }
 
-template <Color::underlying c>
-inline bool movegen::isEpSquareValid(const Board &board, Square ep) {
+template <movegen::MoveGenType mt, typename BoardT>
+inline void movegen::legalmoves(Movelist &movelist, const BoardT &board, const NodeInfo &info, int pieces) {
+    movelist.clear();
+
+    if (board.sideToMove() == Color::WHITE)
+        legalmoves<Color::WHITE, mt>(movelist, board, info, pieces);
+    else
+        legalmoves<Color::BLACK, mt>(movelist, board, info, pieces);
+}
+
+template <Color::underlying c, typename BoardT>
+inline bool movegen::isEpSquareValid(const BoardT &board, Square ep) {
     const auto stm = board.sideToMove();
 
     Bitboard occ_us  = board.us(stm);
@@ -3835,6 +4043,206 @@ inline bool movegen::isEpSquareValid(const Board &board, Square ep) {
     return found;
 }
 
+template <typename BoardT>
+[[nodiscard]] inline movegen::CheckInfo movegen::checkInfo(const BoardT &board) {
+    const auto us      = board.sideToMove();
+    const auto king_sq = board.kingSq(~us);
+    const auto occ     = board.occ();
+
+    const auto bishop = attacks::bishop(king_sq, occ);
+    const auto rook   = attacks::rook(king_sq, occ);
+
+    CheckInfo info;
+    info.king_sq = king_sq;
+    // indexed by PieceType
+    info.check_squares = {attacks::pawn(~us, king_sq), attacks::knight(king_sq), bishop, rook, bishop | rook, 0ull};
+
+    // our sliders that would see the king if exactly one of our pieces were out of the way
+    const auto queens = board.pieces(PieceType::QUEEN, us);
+    Bitboard snipers  = (attacks::bishop(king_sq, 0ull) & (board.pieces(PieceType::BISHOP, us) | queens)) |
+                       (attacks::rook(king_sq, 0ull) & (board.pieces(PieceType::ROOK, us) | queens));
+
+    info.blockers = 0ull;
+    while (snipers) {
+        const auto between = SQUARES_BETWEEN_BB[king_sq.index()][snipers.pop()] & occ;
+        if (between && !between.moreThanOne()) info.blockers |= between & board.us(us);
+    }
+
+    return info;
+}
+
+template <typename BoardT>
+[[nodiscard]] inline bool movegen::givesCheck(const BoardT &board, const Move &move, const CheckInfo &info) {
+    const auto us      = board.sideToMove();
+    const auto from    = move.from();
+    const auto to      = move.to();
+    const auto king_sq = info.king_sq;
+    const auto occ     = board.occ();
+
+    const auto queens = board.pieces(PieceType::QUEEN, us);
+
+    if (move.typeOf() == Move::CASTLING) {
+        // king and rook both move, check every slider against the new occupancy
+        const bool king_side = to > from;
+        const auto rook_to   = Square::castling_rook_square(king_side, us);
+        const auto king_to   = Square::castling_king_square(king_side, us);
+        const auto occ_after = (occ ^ Bitboard::fromSquare(from) ^ Bitboard::fromSquare(to)) |
+                               Bitboard::fromSquare(rook_to) | Bitboard::fromSquare(king_to);
+        const auto rooks     = (board.pieces(PieceType::ROOK, us) ^ Bitboard::fromSquare(to)) |
+                           Bitboard::fromSquare(rook_to);
+        return static_cast<bool>((attacks::bishop(king_sq, occ_after) & (board.pieces(PieceType::BISHOP, us) | queens)) |
+                                 (attacks::rook(king_sq, occ_after) & (rooks | queens)));
+    }
+
+    // direct check
+    if (move.typeOf() == Move::PROMOTION) {
+        const auto occ_after = occ ^ Bitboard::fromSquare(from);
+        Bitboard attacked;
+        switch (static_cast<int>(move.promotionType())) {
+            case static_cast<int>(PieceType::KNIGHT):
+                attacked = attacks::knight(to);
+                break;
+            case static_cast<int>(PieceType::BISHOP):
+                attacked = attacks::bishop(to, occ_after);
+                break;
+            case static_cast<int>(PieceType::ROOK):
+                attacked = attacks::rook(to, occ_after);
+                break;
+            default:
+                attacked = attacks::queen(to, occ_after);
+                break;
+        }
+        if (attacked.check(king_sq.index())) return true;
+    } else if (info.check_squares[board.template at<PieceType>(from)].check(to.index())) {
+        return true;
+    }
+
+    // discovered check, unless the piece stays on the line to the king
+    if (info.blockers.check(from.index()) && !SQUARES_BETWEEN_BB[king_sq.index()][from.index()].check(to.index()) &&
+        !SQUARES_BETWEEN_BB[king_sq.index()][to.index()].check(from.index())) {
+        return true;
+    }
+
+    // en passant removes a second piece from the board
+    if (move.typeOf() == Move::ENPASSANT) {
+        const auto occ_after = (occ ^ Bitboard::fromSquare(from) ^ Bitboard::fromSquare(to.ep_square())) |
+                               Bitboard::fromSquare(to);
+        return static_cast<bool>(
+            (attacks::bishop(king_sq, occ_after) & (board.pieces(PieceType::BISHOP, us) | queens)) |
+            (attacks::rook(king_sq, occ_after) & (board.pieces(PieceType::ROOK, us) | queens)));
+    }
+
+    return false;
+}
+
+template <typename BoardT>
+[[nodiscard]] inline bool movegen::isPseudoLegal(const BoardT &board, const Move &move) {
+    if (move == Move::NO_MOVE || move == Move::NULL_MOVE) return false;
+
+    const auto us    = board.sideToMove();
+    const auto from  = move.from();
+    const auto to    = move.to();
+    const auto piece = board.at(from);
+    const auto occ   = board.occ();
+
+    if (piece == Piece::NONE || piece.color() != us) return false;
+
+    // only promotions use the promotion bits
+    if (move.typeOf() != Move::PROMOTION && move.promotionType() != PieceType::KNIGHT) return false;
+
+    const auto pt = piece.type();
+
+    if (move.typeOf() == Move::CASTLING) {
+        if (pt != PieceType::KING || board.at(to) != Piece(PieceType::ROOK, us)) return false;
+        if (!Square::back_rank(from, us) || from.rank() != to.rank()) return false;
+
+        const auto side = CastlingRights::closestSide(to, from);
+        return board.castlingRights().getRookFile(us, side) == to.file();
+    }
+
+    if (pt == PieceType::PAWN) {
+        // promotions are exactly the moves to the last rank
+        if ((move.typeOf() == Move::PROMOTION) != Rank::back_rank(to.rank(), ~us)) return false;
+
+        const auto captures = attacks::pawn(us, from);
+
+        if (move.typeOf() == Move::ENPASSANT) return to == board.enpassantSq() && captures.check(to.index());
+        if (captures.check(to.index())) return board.us(~us).check(to.index());
+
+        const auto up = make_direction(Direction::NORTH, us);
+
+        if (to == from + up) return !occ.check(to.index());
+
+        // double push
+        return move.typeOf() == Move::NORMAL && from.relative_square(us).rank() == Rank::RANK_2 &&
+               to == from + up + up && !occ.check((from + up).index()) && !occ.check(to.index());
+    }
+
+    if (move.typeOf() != Move::NORMAL || board.us(us).check(to.index())) return false;
+
+    switch (static_cast<int>(pt)) {
+        case static_cast<int>(PieceType::KNIGHT):
+            return attacks::knight(from).check(to.index());
+        case static_cast<int>(PieceType::BISHOP):
+            return attacks::bishop(from, occ).check(to.index());
+        case static_cast<int>(PieceType::ROOK):
+            return attacks::rook(from, occ).check(to.index());
+        case static_cast<int>(PieceType::QUEEN):
+            return attacks::queen(from, occ).check(to.index());
+        default:
+            return attacks::king(from).check(to.index());
+    }
+}
+
+template <typename BoardT>
+[[nodiscard]] inline bool movegen::isLegal(const BoardT &board, const Move &move) {
+    return isLegal(board, move, nodeInfo(board));
+}
+
+template <typename BoardT>
+[[nodiscard]] inline bool movegen::isLegal(const BoardT &board, const Move &move, const NodeInfo &info) {
+    if (board.sideToMove() == Color::WHITE) return isLegal<Color::WHITE>(board, move, info);
+    return isLegal<Color::BLACK>(board, move, info);
+}
+
+template <Color::underlying c, typename BoardT>
+[[nodiscard]] inline bool movegen::isLegal(const BoardT &board, const Move &move, const NodeInfo &info) {
+    const auto king_sq = board.kingSq(c);
+    const auto from    = move.from();
+    const auto to      = move.to();
+
+    if (move.typeOf() == Move::CASTLING) {
+        if (info.checks != 0) return false;
+
+        return generateCastleMoves<c, MoveGenType::ALL>(board, king_sq, info.seen, info.pin_hv).check(to.index());
+    }
+
+    // seen is computed with the king off the board, so it cannot shield its own destination from a slider
+    if (from == king_sq) return !info.seen.check(to.index());
+
+    if (info.checks == 2) return false;
+
+    if (move.typeOf() == Move::ENPASSANT) {
+        const auto pawns_lr = board.pieces(PieceType::PAWN, c) & ~info.pin_hv;
+        const auto moves    = generateEPMove(board, info.checkmask, info.pin_d, pawns_lr, to, c);
+
+        return moves[0] == move || moves[1] == move;
+    }
+
+    if (!info.checkmask.check(to.index())) return false;
+
+    // a pinned piece may only move along its pin
+    if (info.pin_d.check(from.index())) {
+        return info.pin_d.check(to.index()) && from.file() != to.file() && from.rank() != to.rank();
+    }
+
+    if (info.pin_hv.check(from.index())) {
+        return info.pin_hv.check(to.index()) && (from.file() == to.file() || from.rank() == to.rank());
+    }
+
+    return true;
+}
+
 inline const std::array<std::array<Bitboard, 64>, 64> movegen::SQUARES_BETWEEN_BB = [] {
     attacks::initAttacks();
     return movegen::init_squares_between();
@@ -4201,7 +4609,6 @@ class StreamParser {
         auto is_termination_symbol = false;
         auto has_comment           = false;
 
-    start:
         /*
         Skip first move number or game termination
         Also skip - * / to fix games
@@ -4210,7 +4617,7 @@ class StreamParser {
         */
 
         while (auto c = stream_buffer.some()) {
-            if (*c == ' ' || is_digit(*c)) {
+            if (is_space(*c) || is_digit(*c)) {
                 stream_buffer.advance();
             } else if (*c == '-' || *c == '*' || c == '/') {
                 is_termination_symbol = true;
@@ -4230,29 +4637,26 @@ class StreamParser {
 
                     comment += *k;
                 }
-
-                // the game has no moves, but a comment followed by a game termination
-                if (!visitor->skip()) {
-                    visitor->move("", comment.get());
-
-                    comment.clear();
-                }
             } else {
                 break;
             }
         }
 
-        // we need to reparse the termination symbol
-        if (has_comment && !is_termination_symbol) {
-            goto start;
-        }
-
         // game had no moves, so we can skip it and call endPgn
         if (is_termination_symbol) {
+            // the game has no moves, but a comment followed by a game termination
+            if (has_comment && !visitor->skip()) visitor->move("", comment.get());
+
+            comment.clear();
             onEnd();
+            // the loop above stopped on the next game's first character
+            dont_advance_after_body = true;
             return;
         }
 
+        // a comment before the first move is not passed on
+        comment.clear();
+
         while (auto c = stream_buffer.some()) {
             if (is_space(*c)) {
                 stream_buffer.advance();
@@ -4308,6 +4712,7 @@ class StreamParser {
                 break;
             }
 
+        termination:
             // skip spaces
             while (auto c = stream_buffer.some()) {
                 if (is_space(*c)) {
@@ -4380,6 +4785,9 @@ class StreamParser {
                         stream_buffer.advance();
                         break;
                     }
+
+                    // the castling move may be followed by the game termination
+                    goto termination;
                 }
             }
         }
@@ -4719,28 +5127,135 @@ class uci {
                 return move;
             }
 
-            if (move.typeOf() == Move::ENPASSANT) {
-                if (move.from().file() == info.from_file) return move;
-                continue;
+            if (sanFromMatches(info, move.from())) {
+                return move;
             }
+        }
+
+#ifndef CHESS_NO_EXCEPTIONS
+        throw SanParseError("Failed to parse san. At step 3: " + std::string(san) + " " + board.getFen());
+#endif
+    }
+
+    /**
+     * @brief Reasons parseSanFast can fail for.
+     */
+    enum class SanError { NONE, EMPTY, INVALID, ILLEGAL, AMBIGUOUS };
+
+    /**
+     * @brief Parse a san string without generating the legal moves of the position. Only the moves of the
+     * named piece to the target square are built and checked for legality, which makes it the faster choice
+     * when replaying many games. Errors are returned instead of thrown. A promotion without a piece is taken
+     * as a queen promotion.
+     * @param board
+     * @param san
+     * @param move set to the parsed move, or Move::NO_MOVE on error
+     * @return SanError::NONE on success
+     */
+    [[nodiscard]] static SanError parseSanFast(const Board &board, std::string_view san, Move &move) noexcept {
+        move = Move::NO_MOVE;
+
+        if (san.empty()) return SanError::EMPTY;
+
+        SanMoveInformation info;
+        if (!parseSanInfo(san, info)) return SanError::INVALID;
+
+        const auto us      = board.sideToMove();
+        const auto king_sq = board.kingSq(us);
+
+        if (info.castling_short || info.castling_long) {
+            const auto side = info.castling_short ? CastlingRights::Side::KING_SIDE
+                                                  : CastlingRights::Side::QUEEN_SIDE;
+            if (!board.castlingRights().has(us, side)) return SanError::ILLEGAL;
+
+            const auto rook_sq = Square(board.castlingRights().getRookFile(us, side), king_sq.rank());
+            const auto castle  = Move::make<Move::CASTLING>(king_sq, rook_sq);
+            if (!movegen::isPseudoLegal(board, castle) || !movegen::isLegal(board, castle)) return SanError::ILLEGAL;
+
+            move = castle;
+            return SanError::NONE;
+        }
 
-            // we know the from square, so we can check if it matches
-            if (info.from != Square::underlying::NO_SQ) {
-                if (move.from() == info.from) {
-                    return move;
+        // no piece letter, e.g. "xe4", and board.pieces() has no entry for PieceType::NONE
+        if (info.piece == PieceType::NONE) return SanError::INVALID;
+
+        const auto to     = info.to;
+        const auto occ    = board.occ();
+        const auto target = board.at(to);
+
+        if (target != Piece::NONE && target.color() == us) return SanError::ILLEGAL;
+
+        const bool enpassant = info.piece == PieceType::PAWN && info.capture && to == board.enpassantSq();
+        const bool promotion = info.piece == PieceType::PAWN && Square::back_rank(to, ~us);
+
+        if (info.capture != (target != Piece::NONE || enpassant)) return SanError::ILLEGAL;
+        if (info.promotion != PieceType::NONE && !promotion) return SanError::ILLEGAL;
+
+        const auto pieces = board.pieces(info.piece, us);
+        Bitboard from_bb;
+
+        switch (static_cast<int>(info.piece)) {
+            case static_cast<int>(PieceType::PAWN):
+                if (info.capture) {
+                    from_bb = attacks::pawn(~us, to) & pieces;
+                } else {
+                    const auto rank = to.relative_square(us).rank();
+                    if (rank == Rank::RANK_1 || rank == Rank::RANK_2) return SanError::ILLEGAL;
+
+                    const auto down = make_direction(Direction::SOUTH, us);
+                    const auto one  = to + down;
+
+                    if (pieces.check(one.index())) {
+                        from_bb = Bitboard::fromSquare(one);
+                    } else if (rank == Rank::RANK_4 && !occ.check(one.index())) {
+                        from_bb = Bitboard::fromSquare(one + down) & pieces;
+                    }
                 }
+                break;
+            case static_cast<int>(PieceType::KNIGHT):
+                from_bb = attacks::knight(to) & pieces;
+                break;
+            case static_cast<int>(PieceType::BISHOP):
+                from_bb = attacks::bishop(to, occ) & pieces;
+                break;
+            case static_cast<int>(PieceType::ROOK):
+                from_bb = attacks::rook(to, occ) & pieces;
+                break;
+            case static_cast<int>(PieceType::QUEEN):
+                from_bb = attacks::queen(to, occ) & pieces;
+                break;
+            case static_cast<int>(PieceType::KING):
+                from_bb = attacks::king(to) & pieces;
+                break;
+            default:
+                return SanError::INVALID;
+        }
 
-                continue;
+        while (from_bb) {
+            const auto from = Square(from_bb.pop());
+            if (!sanFromMatches(info, from)) continue;
+
+            Move candidate;
+            if (enpassant) {
+                candidate = Move::make<Move::ENPASSANT>(from, to);
+            } else if (promotion) {
+                const auto pt = info.promotion != PieceType::NONE ? info.promotion : PieceType(PieceType::QUEEN);
+                candidate     = Move::make<Move::PROMOTION>(from, to, pt);
+            } else {
+                candidate = Move::make<Move::NORMAL>(from, to);
             }
 
-            if ((move.from().file() == info.from_file) || (move.from().rank() == info.from_rank)) {
-                return move;
+            if (leavesKingAttacked(board, candidate)) continue;
+
+            if (move != Move::NO_MOVE) {
+                move = Move::NO_MOVE;
+                return SanError::AMBIGUOUS;
             }
+
+            move = candidate;
         }
 
-#ifndef CHESS_NO_EXCEPTIONS
-        throw SanParseError("Failed to parse san. At step 3: " + std::string(san) + " " + board.getFen());
-#endif
+        return move != Move::NO_MOVE ? SanError::NONE : SanError::ILLEGAL;
     }
 
    private:
@@ -4761,6 +5276,55 @@ class uci {
         bool capture = false;
     };
 
+    /**
+     * @brief Whether a move from the given square fits the disambiguation of the san.
+     * @param info
+     * @param from
+     * @return
+     */
+    [[nodiscard]] static bool sanFromMatches(const SanMoveInformation &info, Square from) noexcept {
+        // we know the from square, so we can check if it matches
+        if (info.from != Square::underlying::NO_SQ) return from == info.from;
+
+        // for simple moves like Nf3
+        if (info.from_file == File::NO_FILE && info.from_rank == Rank::NO_RANK) return true;
+
+        return from.file() == info.from_file || from.rank() == info.from_rank;
+    }
+
+    /**
+     * @brief Whether a non-castling move leaves the own king attacked. Looks at the attackers of the king
+     * square with the occupancy after the move, so the move is never made.
+     * @param board
+     * @param move
+     * @return
+     */
+    [[nodiscard]] static bool leavesKingAttacked(const Board &board, const Move &move) noexcept {
+        const auto us   = board.sideToMove();
+        const auto from = move.from();
+        const auto to   = move.to();
+
+        auto occ      = (board.occ() ^ Bitboard::fromSquare(from)) | Bitboard::fromSquare(to);
+        auto captured = Bitboard::fromSquare(to);
+
+        if (move.typeOf() == Move::ENPASSANT) {
+            captured = Bitboard::fromSquare(to.ep_square());
+            occ &= ~captured;
+        }
+
+        const auto king_sq = board.at(from).type() == PieceType::KING ? to : board.kingSq(us);
+        const auto them    = board.us(~us) & ~captured;
+        const auto queens  = board.pieces(PieceType::QUEEN, ~us);
+
+        const auto attackers = (attacks::bishop(king_sq, occ) & (board.pieces(PieceType::BISHOP, ~us) | queens)) |
+                               (attacks::rook(king_sq, occ) & (board.pieces(PieceType::ROOK, ~us) | queens)) |
+                               (attacks::knight(king_sq) & board.pieces(PieceType::KNIGHT, ~us)) |
+                               (attacks::pawn(us, king_sq) & board.pieces(PieceType::PAWN, ~us)) |
+                               (attacks::king(king_sq) & board.pieces(PieceType::KING, ~us));
+
+        return static_cast<bool>(attackers & them);
+    }
+
     template <bool PEDANTIC = false>
     [[nodiscard]] static SanMoveInformation parseSanInfo(std::string_view san) noexcept(false) {
 #ifndef CHESS_NO_EXCEPTIONS
@@ -4770,6 +5334,26 @@ class uci {
             }
         }
 #endif
+        SanMoveInformation info;
+
+        if (!parseSanInfo(san, info)) {
+#ifndef CHESS_NO_EXCEPTIONS
+            throw SanParseError("Failed to parse san. At step 1: " + std::string(san));
+#endif
+        }
+
+        return info;
+    }
+
+    /**
+     * @brief Fills info from the san string.
+     * @param san
+     * @param info
+     * @return false if the san is empty, names no complete target square or has an invalid promotion
+     */
+    [[nodiscard]] static bool parseSanInfo(std::string_view san, SanMoveInformation &info) noexcept {
+        if (san.empty()) return false;
+
         constexpr auto parse_castle = [](std::string_view &san, SanMoveInformation &info, char castling_char) {
             info.piece = PieceType::KING;
 
@@ -4786,14 +5370,14 @@ class uci {
         static constexpr auto isFile = [](char c) { return c >= 'a' && c <= 'h'; };
         static constexpr auto sw     = [](const char &c) { return std::string_view(&c, 1); };
 
-        SanMoveInformation info;
-
         // set to 1 to skip piece type offset
         std::size_t index = 1;
 
         if (san[0] == 'O' || san[0] == '0') {
+            if (san.size() < 3 || san[1] != '-' || san[2] != san[0]) return false;
+
             parse_castle(san, info, san[0]);
-            return info;
+            return info.castling_short || info.castling_long;
         } else if (isFile(san[0])) {
             index--;
             info.piece = PieceType::PAWN;
@@ -4837,13 +5421,13 @@ class uci {
         // promotion
         if (index < san.size() && san[index] == '=') {
             index++;
+            if (index == san.size()) return false;
+
             info.promotion = PieceType(sw(san[index]));
 
-#ifndef CHESS_NO_EXCEPTIONS
             if (info.promotion == PieceType::KING || info.promotion == PieceType::PAWN ||
                 info.promotion == PieceType::NONE)
-                throw SanParseError("Failed to parse promotion, during san conversion." + std::string(san));
-#endif
+                return false;
 
             index++;
         }
@@ -4863,13 +5447,15 @@ class uci {
             info.from_file = file_to;
         }
 
+        if (file_to == File::NO_FILE || rank_to == Rank::NO_RANK) return false;
+
         info.to = Square(file_to, rank_to);
 
         if (info.from_file != File::NO_FILE && info.from_rank != Rank::NO_RANK) {
             info.from = Square(info.from_file, info.from_rank);
         }
 
-        return info;
+        return true;
     }
 
     template <bool LAN = false>
@@ -4894,17 +5480,27 @@ class uci {
             Movelist moves;
             movegen::legalmoves(moves, board);
 
+            bool ambiguous = false;
+            bool same_file = false;
+            bool same_rank = false;
+
             for (const auto &m : moves) {
-                // check for ambiguity
+                // check for ambiguity, against every other piece of the type that can reach the square
                 if (pt != PieceType::PAWN && m != move && board.at(m.from()) == board.at(move.from()) &&
                     m.to() == move.to()) {
-                    if (m.from().file() == move.from().file()) {
-                        str += static_cast<std::string>(move.from().rank());
-                        break;
-                    } else {
-                        str += static_cast<std::string>(move.from().file());
-                        break;
-                    }
+                    ambiguous = true;
+                    same_file |= m.from().file() == move.from().file();
+                    same_rank |= m.from().rank() == move.from().rank();
+                }
+            }
+
+            if (ambiguous) {
+                if (!same_file || same_rank) {
+                    str += static_cast<std::string>(move.from().file());
+                }
+
+                if (same_file) {
+                    str += static_cast<std::string>(move.from().rank());
                 }
             }
         }
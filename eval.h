@@ -0,0 +1,420 @@
+#pragma once
+
+#include <cstdint>
+
+#include "./chess.h"
+#include "./position.h"
+
+using namespace chess;
+
+static constexpr int DOUBLE_PAWN_PENALTY = -10;
+static constexpr int ISOLATED_PAWN_PENALTY = -10;
+
+static constexpr int WHITE_PASSED_PAWN_BONUS[8] = {0,  10,  30,  50,
+                                                   75, 100, 150, 200};
+static constexpr int BLACK_PASSED_PAWN_BONUS[8] = {200, 150, 100, 75,
+                                                   50,  30,  10,  0};
+
+static constexpr uint64_t FILE_MASK[64] = {
+    0x101010101010101,  0x202020202020202,  0x404040404040404,
+    0x808080808080808,  0x1010101010101010, 0x2020202020202020,
+    0x4040404040404040, 0x8080808080808080, 0x101010101010101,
+    0x202020202020202,  0x404040404040404,  0x808080808080808,
+    0x1010101010101010, 0x2020202020202020, 0x4040404040404040,
+    0x8080808080808080, 0x101010101010101,  0x202020202020202,
+    0x404040404040404,  0x808080808080808,  0x1010101010101010,
+    0x2020202020202020, 0x4040404040404040, 0x8080808080808080,
+    0x101010101010101,  0x202020202020202,  0x404040404040404,
+    0x808080808080808,  0x1010101010101010, 0x2020202020202020,
+    0x4040404040404040, 0x8080808080808080, 0x101010101010101,
+    0x202020202020202,  0x404040404040404,  0x808080808080808,
+    0x1010101010101010, 0x2020202020202020, 0x4040404040404040,
+    0x8080808080808080, 0x101010101010101,  0x202020202020202,
+    0x404040404040404,  0x808080808080808,  0x1010101010101010,
+    0x2020202020202020, 0x4040404040404040, 0x8080808080808080,
+    0x101010101010101,  0x202020202020202,  0x404040404040404,
+    0x808080808080808,  0x1010101010101010, 0x2020202020202020,
+    0x4040404040404040, 0x8080808080808080, 0x101010101010101,
+    0x202020202020202,  0x404040404040404,  0x808080808080808,
+    0x1010101010101010, 0x2020202020202020, 0x4040404040404040,
+    0x8080808080808080};
+
+static constexpr uint64_t ISOLATED_PAWN_MASK[64] = {
+    0x202020202020202,  0x505050505050505,  0xa0a0a0a0a0a0a0a,
+    0x1414141414141414, 0x2828282828282828, 0x5050505050505050,
+    0xa0a0a0a0a0a0a0a0, 0x4040404040404040, 0x202020202020202,
+    0x505050505050505,  0xa0a0a0a0a0a0a0a,  0x1414141414141414,
+    0x2828282828282828, 0x5050505050505050, 0xa0a0a0a0a0a0a0a0,
+    0x4040404040404040, 0x202020202020202,  0x505050505050505,
+    0xa0a0a0a0a0a0a0a,  0x1414141414141414, 0x2828282828282828,
+    0x5050505050505050, 0xa0a0a0a0a0a0a0a0, 0x4040404040404040,
+    0x202020202020202,  0x505050505050505,  0xa0a0a0a0a0a0a0a,
+    0x1414141414141414, 0x2828282828282828, 0x5050505050505050,
+    0xa0a0a0a0a0a0a0a0, 0x4040404040404040, 0x202020202020202,
+    0x505050505050505,  0xa0a0a0a0a0a0a0a,  0x1414141414141414,
+    0x2828282828282828, 0x5050505050505050, 0xa0a0a0a0a0a0a0a0,
+    0x4040404040404040, 0x202020202020202,  0x505050505050505,
+    0xa0a0a0a0a0a0a0a,  0x1414141414141414, 0x2828282828282828,
+    0x5050505050505050, 0xa0a0a0a0a0a0a0a0, 0x4040404040404040,
+    0x202020202020202,  0x505050505050505,  0xa0a0a0a0a0a0a0a,
+    0x1414141414141414, 0x2828282828282828, 0x5050505050505050,
+    0xa0a0a0a0a0a0a0a0, 0x4040404040404040, 0x202020202020202,
+    0x505050505050505,  0xa0a0a0a0a0a0a0a,  0x1414141414141414,
+    0x2828282828282828, 0x5050505050505050, 0xa0a0a0a0a0a0a0a0,
+    0x4040404040404040,
+};
+
+static constexpr uint64_t WHITE_PASSED_PAWN_MASK[64] = {
+    0x303030303030300,
+    0x707070707070700,
+    0xe0e0e0e0e0e0e00,
+    0x1c1c1c1c1c1c1c00,
+    0x3838383838383800,
+    0x7070707070707000,
+    0xe0e0e0e0e0e0e000,
+    0xc0c0c0c0c0c0c000,
+    0x303030303030000,
+    0x707070707070000,
+    0xe0e0e0e0e0e0000,
+    0x1c1c1c1c1c1c0000,
+    0x3838383838380000,
+    0x7070707070700000,
+    0xe0e0e0e0e0e00000,
+    0xc0c0c0c0c0c00000,
+    0x303030303000000,
+    0x707070707000000,
+    0xe0e0e0e0e000000,
+    0x1c1c1c1c1c000000,
+    0x3838383838000000,
+    0x7070707070000000,
+    0xe0e0e0e0e0000000,
+    0xc0c0c0c0c0000000,
+    0x303030300000000,
+    0x707070700000000,
+    0xe0e0e0e00000000,
+    0x1c1c1c1c00000000,
+    0x3838383800000000,
+    0x7070707000000000,
+    0xe0e0e0e000000000,
+    0xc0c0c0c000000000,
+    0x303030000000000,
+    0x707070000000000,
+    0xe0e0e0000000000,
+    0x1c1c1c0000000000,
+    0x3838380000000000,
+    0x7070700000000000,
+    0xe0e0e00000000000,
+    0xc0c0c00000000000,
+    0x303000000000000,
+    0x707000000000000,
+    0xe0e000000000000,
+    0x1c1c000000000000,
+    0x3838000000000000,
+    0x7070000000000000,
+    0xe0e0000000000000,
+    0xc0c0000000000000,
+    0x300000000000000,
+    0x700000000000000,
+    0xe00000000000000,
+    0x1c00000000000000,
+    0x3800000000000000,
+    0x7000000000000000,
+    0xe000000000000000,
+    0xc000000000000000,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+};
+
+static constexpr uint64_t BLACK_PASSED_PAWN_MASK[64] = {
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x0,
+    0x3,
+    0x7,
+    0xe,
+    0x1c,
+    0x38,
+    0x70,
+    0xe0,
+    0xc0,
+    0x303,
+    0x707,
+    0xe0e,
+    0x1c1c,
+    0x3838,
+    0x7070,
+    0xe0e0,
+    0xc0c0,
+    0x30303,
+    0x70707,
+    0xe0e0e,
+    0x1c1c1c,
+    0x383838,
+    0x707070,
+    0xe0e0e0,
+    0xc0c0c0,
+    0x3030303,
+    0x7070707,
+    0xe0e0e0e,
+    0x1c1c1c1c,
+    0x38383838,
+    0x70707070,
+    0xe0e0e0e0,
+    0xc0c0c0c0,
+    0x303030303,
+    0x707070707,
+    0xe0e0e0e0e,
+    0x1c1c1c1c1c,
+    0x3838383838,
+    0x7070707070,
+    0xe0e0e0e0e0,
+    0xc0c0c0c0c0,
+    0x30303030303,
+    0x70707070707,
+    0xe0e0e0e0e0e,
+    0x1c1c1c1c1c1c,
+    0x383838383838,
+    0x707070707070,
+    0xe0e0e0e0e0e0,
+    0xc0c0c0c0c0c0,
+    0x3030303030303,
+    0x7070707070707,
+    0xe0e0e0e0e0e0e,
+    0x1c1c1c1c1c1c1c,
+    0x38383838383838,
+    0x70707070707070,
+    0xe0e0e0e0e0e0e0,
+    0xc0c0c0c0c0c0c0,
+};
+
+static constexpr uint8_t WHITE_SQ_INDEX[64] = {
+    56, 57, 58, 59, 60, 61, 62, 63,  //
+    48, 49, 50, 51, 52, 53, 54, 55,  //
+    40, 41, 42, 43, 44, 45, 46, 47,  //
+    32, 33, 34, 35, 36, 37, 38, 39,  //
+    24, 25, 26, 27, 28, 29, 30, 31,  //
+    16, 17, 18, 19, 20, 21, 22, 23,  //
+    8,  9,  10, 11, 12, 13, 14, 15,  //
+    0,  1,  2,  3,  4,  5,  6,  7,
+};
+
+static constexpr int BLACK_SQ_INDEX[64] = {
+    0,  1,  2,  3,  4,  5,  6,  7,   //
+    8,  9,  10, 11, 12, 13, 14, 15,  //
+    16, 17, 18, 19, 20, 21, 22, 23,  //
+    24, 25, 26, 27, 28, 29, 30, 31,  //
+    32, 33, 34, 35, 36, 37, 38, 39,  //
+    40, 41, 42, 43, 44, 45, 46, 47,  //
+    48, 49, 50, 51, 52, 53, 54, 55,  //
+    56, 57, 58, 59, 60, 61, 62, 63,
+};
+
+static constexpr int PAWN_OPENING_SQ_VALUE[64] = {
+    0,  0,  0,   0,   0,   0,   0,  0,   //
+    50, 50, 50,  50,  50,  50,  50, 50,  //
+    10, 10, 20,  30,  30,  20,  10, 10,  //
+    5,  5,  10,  25,  25,  10,  5,  5,   //
+    0,  0,  0,   20,  22,  0,   0,  0,   //
+    5,  -5, -10, 0,   0,   -10, -5, 5,   //
+    5,  10, 10,  -40, -40, 10,  10, 5,   //
+    0,  0,  0,   0,   0,   0,   0,  0};
+
+static constexpr int PAWN_ENDGAME_SQ_VALUE[64] = {
+    0,   0,   0,   0,   0,   0,   0,   0,    //
+    178, 173, 158, 134, 147, 132, 165, 187,  //
+    94,  100, 85,  67,  56,  53,  82,  84,   //
+    32,  24,  13,  5,   -2,  4,   17,  17,   //
+    13,  9,   -3,  -7,  -7,  -8,  3,   -1,   //
+    4,   7,   -6,  1,   0,   -5,  -1,  -8,   //
+    13,  8,   8,   10,  13,  0,   2,   -7,   //
+    0,   0,   0,   0,   0,   0,   0,   0};
+
+static constexpr int KNIGHT_SQ_VALUE[64] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,  //
+    -40, -20, 0,   0,   0,   0,   -20, -40,  //
+    -30, 0,   10,  15,  15,  10,  0,   -30,  //
+    -30, 5,   15,  20,  20,  15,  5,   -30,  //
+    -30, 0,   15,  20,  20,  15,  0,   -30,  //
+    -30, 5,   10,  15,  15,  10,  5,   -30,  //
+    -40, -20, 0,   5,   5,   0,   -20, -40,  //
+    -50, -40, -30, -30, -30, -30, -40, -50,
+};
+
+static constexpr int BISHOP_SQ_VALUE[64] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,  //
+    -10, 0,   0,   0,   0,   0,   0,   -10,  //
+    -10, 0,   5,   10,  10,  5,   0,   -10,  //
+    -10, 5,   5,   10,  10,  5,   5,   -10,  //
+    -10, 0,   10,  10,  10,  10,  0,   -10,  //
+    -10, 10,  10,  10,  10,  10,  10,  -10,  //
+    -10, 5,   0,   0,   0,   0,   5,   -10,  //
+    -20, -10, -10, -10, -10, -10, -10, -20,
+};
+
+static constexpr int ROOK_SQ_VALUE[64] = {0,  0,  0,  0,  0,  0,  0,  0,   //
+                                          5,  10, 10, 10, 10, 10, 10, 5,   //
+                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
+                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
+                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
+                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
+                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
+                                          0,  0,  0,  5,  5,  0,  0,  0};
+
+static constexpr int QUEEN_SQ_VALUE[64] = {
+    -20, -10, -10, -5, -5, -10, -10, -20,  //
+    -10, 0,   0,   0,  0,  0,   0,   -10,  //
+    -10, 0,   5,   5,  5,  5,   0,   -10,  //
+    -5,  0,   5,   5,  5,  5,   0,   -5,   //
+    0,   0,   5,   5,  5,  5,   0,   -5,   //
+    -10, 5,   5,   5,  5,  5,   0,   -10,  //
+    -10, 0,   5,   0,  0,  0,   0,   -10,  //
+    -20, -10, -10, -5, -5, -10, -10, -20};
+
+static constexpr int KING_OPENING_SQ_VALUE[64] = {
+    -40, -40, -40, -40, -40, -40, -40, -40,  //
+    -40, -40, -40, -40, -40, -40, -40, -40,  //
+    -40, -40, -40, -40, -40, -40, -40, -40,  //
+    -40, -40, -40, -40, -40, -40, -40, -40,  //
+    -40, -40, -40, -40, -40, -40, -40, -40,  //
+    -40, -40, -40, -40, -40, -40, -40, -40,  //
+    -20, -20, -20, -20, -20, -20, -20, -20,  //
+    0,   20,  40,  -20, 0,   -20, 40,  20};
+
+static constexpr int KING_ENDGAME_SQ_VALUE[64] = {
+    0,  10, 20, 30, 30, 20, 10, 0,   //
+    10, 20, 30, 40, 40, 30, 20, 10,  //
+    20, 30, 40, 50, 50, 40, 30, 20,  //
+    30, 40, 50, 60, 60, 50, 40, 30,  //
+    30, 40, 50, 60, 60, 50, 40, 30,  //
+    20, 30, 40, 50, 50, 40, 30, 20,  //
+    10, 20, 30, 40, 40, 30, 20, 10,  //
+    0,  10, 20, 30, 30, 20, 10, 0};
+
+// Evaluation terms from white's point of view. Base terms count fully, the
+// opening and endgame terms are blended by the number of pieces left.
+struct EvalTerms {
+  int base = 0;
+  int opening = 0;
+  int endgame = 0;
+  int num_pieces = 0;
+
+  int Blend() const {
+    float phase = num_pieces / 32.0f;
+    return base + opening * phase + (1 - phase) * endgame;
+  }
+};
+
+// Cheap evaluation tier: material and piece-square values.
+void AddMaterialTerms(const SearchPosition &board, EvalTerms &terms) {
+  for (auto c : {Color::WHITE, Color::BLACK}) {
+    auto king = board.pieces(PieceType::KING, c);
+    auto queens = board.pieces(PieceType::QUEEN, c);
+    auto rooks = board.pieces(PieceType::ROOK, c);
+    auto bishops = board.pieces(PieceType::BISHOP, c);
+    auto knights = board.pieces(PieceType::KNIGHT, c);
+    auto pawns = board.pieces(PieceType::PAWN, c);
+
+    int sign = (c == Color::WHITE) ? 1 : -1;
+    // pieces bitboard is copied
+    auto f = [&terms, &c, &sign](int &target, auto pieces, auto sq_value,
+                                 int value) {
+      while (pieces) {
+        terms.num_pieces++;
+        auto sq = pieces.pop();
+        if (c == Color::WHITE)
+          sq = WHITE_SQ_INDEX[sq];
+        else
+          sq = BLACK_SQ_INDEX[sq];
+        target += (value + sq_value[sq]) * sign;
+        // target += value * sign;
+      }
+    };
+    f(terms.base, queens, QUEEN_SQ_VALUE, 900);
+    f(terms.base, rooks, ROOK_SQ_VALUE, 500);
+    f(terms.base, bishops, BISHOP_SQ_VALUE, 330);
+    f(terms.base, knights, KNIGHT_SQ_VALUE, 320);
+    f(terms.opening, pawns, PAWN_OPENING_SQ_VALUE, 100);
+    f(terms.endgame, pawns, PAWN_ENDGAME_SQ_VALUE, 100);
+    f(terms.opening, king, KING_OPENING_SQ_VALUE, 20000);
+    f(terms.endgame, king, KING_ENDGAME_SQ_VALUE, 20000);
+  }
+}
+
+// Expensive evaluation tier: pawn structure and king safety.
+CHESS_CPU_DISPATCH void AddStructureTerms(const SearchPosition &board, EvalTerms &terms) {
+  for (auto c : {Color::WHITE, Color::BLACK}) {
+    auto king = board.pieces(PieceType::KING, c);
+    auto pawns = board.pieces(PieceType::PAWN, c);
+
+    int sign = (c == Color::WHITE) ? 1 : -1;
+
+    auto pawn_position_value = [&board, &c, &sign](int &target,
+                                                   Bitboard pawns) {
+      uint64_t our_pawns = board.pieces(PieceType::PAWN, c).getBits();
+      uint64_t their_pawns = board.pieces(PieceType::PAWN, ~c).getBits();
+      while (pawns) {
+        Square sq = pawns.pop();
+        // Double pawn
+        uint64_t double_pawns = FILE_MASK[sq.index()] & our_pawns;
+        bool not_double =
+            (double_pawns & (double_pawns - 1)) == 0 && double_pawns != 0;
+        if (!not_double) {
+          // std::cout << "applying double pawn penalty" << std::endl;
+          target += DOUBLE_PAWN_PENALTY * sign;
+        }
+
+        // Isolated pawn
+        uint64_t neighbor_pawns = ISOLATED_PAWN_MASK[sq.index()] & our_pawns;
+        // std::cout << Bitboard(isolated_pawns) << std::endl;
+        if (neighbor_pawns == 0) {
+          // std::cout << "applying isolated pawn penalty" << std::endl;
+          target += ISOLATED_PAWN_PENALTY * sign;
+        }
+
+        // Passed pawn
+        uint64_t passed_pawn_blocker =
+            ((c == Color::WHITE) ? WHITE_PASSED_PAWN_MASK[sq.index()]
+                                 : BLACK_PASSED_PAWN_MASK[sq.index()]) &
+            their_pawns;
+        if (passed_pawn_blocker == 0) {
+          int bonus = (c == Color::WHITE ? WHITE_PASSED_PAWN_BONUS[sq.rank()]
+                                         : BLACK_PASSED_PAWN_BONUS[sq.rank()]);
+          // std::cout << "applying passed pawn bonus " << bonus << std::endl;
+          target += bonus * sign;
+        }
+      }
+    };
+
+    pawn_position_value(terms.base, pawns);
+
+    auto king_safety_value = [&board, &c, &sign](int &target, Bitboard king) {
+      while (king) {
+        auto sq = king.pop();
+        Bitboard occ = board.us(c);
+        Bitboard occ_their = board.us(~c);
+        Bitboard neighbor = attacks::king(sq) & occ;
+        Bitboard neighbor_their = attacks::king(sq) & occ_their;
+        target += (neighbor.count() - neighbor_their.count()) * 15 * sign;
+      }
+    };
+    king_safety_value(terms.opening, king);
+  }
+}
+
+int Evaluate(const SearchPosition &board) {
+  EvalTerms terms;
+  AddMaterialTerms(board, terms);
+  AddStructureTerms(board, terms);
+  return terms.Blend();
+}
@@ -127,10 +127,16 @@ void ScoreMove(Board& board, Move& move) {
   bool is_pawn_occupying_center = IsPawnOccupyingCenter(board, move, color);
   float is_knight_development = IsKnightDevelopment(board, move, color);
   bool is_bishop_development = IsBishopDevelopment(board, move, color);
-  board.makeMove(move);
-  bool is_check = board.inCheck();
-  bool rooks_connected_now = AreRooksConnected(board, color);
-  board.unmakeMove(move);
+  bool is_check = board.givesCheck(move);
+  // Only a move from or to the back rank can connect the rooks.
+  bool rooks_connected_now = false;
+  if (rooks_not_connected_before &&
+      (Rank::back_rank(move.from().rank(), color) ||
+       Rank::back_rank(move.to().rank(), color))) {
+    board.makeMove(move);
+    rooks_connected_now = AreRooksConnected(board, color);
+    board.unmakeMove(move);
+  }
 
   // Check
   if (is_check) score += 30;
@@ -1,313 +1,45 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <list>
 #include <map>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "./chess.h"
+#include "./eval.h"
+#include "./mapped_pgn.h"
+#include "./perf_counters.h"
+#include "./position.h"
+#include "./stats.h"
 
 using namespace chess;
 
 constexpr int INF = 9999999;
 constexpr int NINF = -INF;
+// Score for being checkmated at the root; mates further away score less.
+constexpr int MATE = 999999;
+// Scores beyond this are mate scores and must not be used for pruning.
+constexpr int MATE_BOUND = MATE - 1000;
 
-static constexpr int DOUBLE_PAWN_PENALTY = -10;
-static constexpr int ISOLATED_PAWN_PENALTY = -10;
-
-static constexpr int WHITE_PASSED_PAWN_BONUS[8] = {0,  10,  30,  50,
-                                                   75, 100, 150, 200};
-static constexpr int BLACK_PASSED_PAWN_BONUS[8] = {200, 150, 100, 75,
-                                                   50,  30,  10,  0};
-
-static constexpr uint64_t FILE_MASK[64] = {
-    0x101010101010101,  0x202020202020202,  0x404040404040404,
-    0x808080808080808,  0x1010101010101010, 0x2020202020202020,
-    0x4040404040404040, 0x8080808080808080, 0x101010101010101,
-    0x202020202020202,  0x404040404040404,  0x808080808080808,
-    0x1010101010101010, 0x2020202020202020, 0x4040404040404040,
-    0x8080808080808080, 0x101010101010101,  0x202020202020202,
-    0x404040404040404,  0x808080808080808,  0x1010101010101010,
-    0x2020202020202020, 0x4040404040404040, 0x8080808080808080,
-    0x101010101010101,  0x202020202020202,  0x404040404040404,
-    0x808080808080808,  0x1010101010101010, 0x2020202020202020,
-    0x4040404040404040, 0x8080808080808080, 0x101010101010101,
-    0x202020202020202,  0x404040404040404,  0x808080808080808,
-    0x1010101010101010, 0x2020202020202020, 0x4040404040404040,
-    0x8080808080808080, 0x101010101010101,  0x202020202020202,
-    0x404040404040404,  0x808080808080808,  0x1010101010101010,
-    0x2020202020202020, 0x4040404040404040, 0x8080808080808080,
-    0x101010101010101,  0x202020202020202,  0x404040404040404,
-    0x808080808080808,  0x1010101010101010, 0x2020202020202020,
-    0x4040404040404040, 0x8080808080808080, 0x101010101010101,
-    0x202020202020202,  0x404040404040404,  0x808080808080808,
-    0x1010101010101010, 0x2020202020202020, 0x4040404040404040,
-    0x8080808080808080};
-
-static constexpr uint64_t ISOLATED_PAWN_MASK[64] = {
-    0x202020202020202,  0x505050505050505,  0xa0a0a0a0a0a0a0a,
-    0x1414141414141414, 0x2828282828282828, 0x5050505050505050,
-    0xa0a0a0a0a0a0a0a0, 0x4040404040404040, 0x202020202020202,
-    0x505050505050505,  0xa0a0a0a0a0a0a0a,  0x1414141414141414,
-    0x2828282828282828, 0x5050505050505050, 0xa0a0a0a0a0a0a0a0,
-    0x4040404040404040, 0x202020202020202,  0x505050505050505,
-    0xa0a0a0a0a0a0a0a,  0x1414141414141414, 0x2828282828282828,
-    0x5050505050505050, 0xa0a0a0a0a0a0a0a0, 0x4040404040404040,
-    0x202020202020202,  0x505050505050505,  0xa0a0a0a0a0a0a0a,
-    0x1414141414141414, 0x2828282828282828, 0x5050505050505050,
-    0xa0a0a0a0a0a0a0a0, 0x4040404040404040, 0x202020202020202,
-    0x505050505050505,  0xa0a0a0a0a0a0a0a,  0x1414141414141414,
-    0x2828282828282828, 0x5050505050505050, 0xa0a0a0a0a0a0a0a0,
-    0x4040404040404040, 0x202020202020202,  0x505050505050505,
-    0xa0a0a0a0a0a0a0a,  0x1414141414141414, 0x2828282828282828,
-    0x5050505050505050, 0xa0a0a0a0a0a0a0a0, 0x4040404040404040,
-    0x202020202020202,  0x505050505050505,  0xa0a0a0a0a0a0a0a,
-    0x1414141414141414, 0x2828282828282828, 0x5050505050505050,
-    0xa0a0a0a0a0a0a0a0, 0x4040404040404040, 0x202020202020202,
-    0x505050505050505,  0xa0a0a0a0a0a0a0a,  0x1414141414141414,
-    0x2828282828282828, 0x5050505050505050, 0xa0a0a0a0a0a0a0a0,
-    0x4040404040404040,
-};
-
-static constexpr uint64_t WHITE_PASSED_PAWN_MASK[64] = {
-    0x303030303030300,
-    0x707070707070700,
-    0xe0e0e0e0e0e0e00,
-    0x1c1c1c1c1c1c1c00,
-    0x3838383838383800,
-    0x7070707070707000,
-    0xe0e0e0e0e0e0e000,
-    0xc0c0c0c0c0c0c000,
-    0x303030303030000,
-    0x707070707070000,
-    0xe0e0e0e0e0e0000,
-    0x1c1c1c1c1c1c0000,
-    0x3838383838380000,
-    0x7070707070700000,
-    0xe0e0e0e0e0e00000,
-    0xc0c0c0c0c0c00000,
-    0x303030303000000,
-    0x707070707000000,
-    0xe0e0e0e0e000000,
-    0x1c1c1c1c1c000000,
-    0x3838383838000000,
-    0x7070707070000000,
-    0xe0e0e0e0e0000000,
-    0xc0c0c0c0c0000000,
-    0x303030300000000,
-    0x707070700000000,
-    0xe0e0e0e00000000,
-    0x1c1c1c1c00000000,
-    0x3838383800000000,
-    0x7070707000000000,
-    0xe0e0e0e000000000,
-    0xc0c0c0c000000000,
-    0x303030000000000,
-    0x707070000000000,
-    0xe0e0e0000000000,
-    0x1c1c1c0000000000,
-    0x3838380000000000,
-    0x7070700000000000,
-    0xe0e0e00000000000,
-    0xc0c0c00000000000,
-    0x303000000000000,
-    0x707000000000000,
-    0xe0e000000000000,
-    0x1c1c000000000000,
-    0x3838000000000000,
-    0x7070000000000000,
-    0xe0e0000000000000,
-    0xc0c0000000000000,
-    0x300000000000000,
-    0x700000000000000,
-    0xe00000000000000,
-    0x1c00000000000000,
-    0x3800000000000000,
-    0x7000000000000000,
-    0xe000000000000000,
-    0xc000000000000000,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-};
-
-static constexpr uint64_t BLACK_PASSED_PAWN_MASK[64] = {
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x0,
-    0x3,
-    0x7,
-    0xe,
-    0x1c,
-    0x38,
-    0x70,
-    0xe0,
-    0xc0,
-    0x303,
-    0x707,
-    0xe0e,
-    0x1c1c,
-    0x3838,
-    0x7070,
-    0xe0e0,
-    0xc0c0,
-    0x30303,
-    0x70707,
-    0xe0e0e,
-    0x1c1c1c,
-    0x383838,
-    0x707070,
-    0xe0e0e0,
-    0xc0c0c0,
-    0x3030303,
-    0x7070707,
-    0xe0e0e0e,
-    0x1c1c1c1c,
-    0x38383838,
-    0x70707070,
-    0xe0e0e0e0,
-    0xc0c0c0c0,
-    0x303030303,
-    0x707070707,
-    0xe0e0e0e0e,
-    0x1c1c1c1c1c,
-    0x3838383838,
-    0x7070707070,
-    0xe0e0e0e0e0,
-    0xc0c0c0c0c0,
-    0x30303030303,
-    0x70707070707,
-    0xe0e0e0e0e0e,
-    0x1c1c1c1c1c1c,
-    0x383838383838,
-    0x707070707070,
-    0xe0e0e0e0e0e0,
-    0xc0c0c0c0c0c0,
-    0x3030303030303,
-    0x7070707070707,
-    0xe0e0e0e0e0e0e,
-    0x1c1c1c1c1c1c1c,
-    0x38383838383838,
-    0x70707070707070,
-    0xe0e0e0e0e0e0e0,
-    0xc0c0c0c0c0c0c0,
-};
-
-static constexpr uint8_t WHITE_SQ_INDEX[64] = {
-    56, 57, 58, 59, 60, 61, 62, 63,  //
-    48, 49, 50, 51, 52, 53, 54, 55,  //
-    40, 41, 42, 43, 44, 45, 46, 47,  //
-    32, 33, 34, 35, 36, 37, 38, 39,  //
-    24, 25, 26, 27, 28, 29, 30, 31,  //
-    16, 17, 18, 19, 20, 21, 22, 23,  //
-    8,  9,  10, 11, 12, 13, 14, 15,  //
-    0,  1,  2,  3,  4,  5,  6,  7,
-};
-
-static constexpr int BLACK_SQ_INDEX[64] = {
-    0,  1,  2,  3,  4,  5,  6,  7,   //
-    8,  9,  10, 11, 12, 13, 14, 15,  //
-    16, 17, 18, 19, 20, 21, 22, 23,  //
-    24, 25, 26, 27, 28, 29, 30, 31,  //
-    32, 33, 34, 35, 36, 37, 38, 39,  //
-    40, 41, 42, 43, 44, 45, 46, 47,  //
-    48, 49, 50, 51, 52, 53, 54, 55,  //
-    56, 57, 58, 59, 60, 61, 62, 63,
-};
-
-static constexpr int PAWN_OPENING_SQ_VALUE[64] = {
-    0,  0,  0,   0,   0,   0,   0,  0,   //
-    50, 50, 50,  50,  50,  50,  50, 50,  //
-    10, 10, 20,  30,  30,  20,  10, 10,  //
-    5,  5,  10,  25,  25,  10,  5,  5,   //
-    0,  0,  0,   20,  22,  0,   0,  0,   //
-    5,  -5, -10, 0,   0,   -10, -5, 5,   //
-    5,  10, 10,  -40, -40, 10,  10, 5,   //
-    0,  0,  0,   0,   0,   0,   0,  0};
-
-static constexpr int PAWN_ENDGAME_SQ_VALUE[64] = {
-    0,   0,   0,   0,   0,   0,   0,   0,    //
-    178, 173, 158, 134, 147, 132, 165, 187,  //
-    94,  100, 85,  67,  56,  53,  82,  84,   //
-    32,  24,  13,  5,   -2,  4,   17,  17,   //
-    13,  9,   -3,  -7,  -7,  -8,  3,   -1,   //
-    4,   7,   -6,  1,   0,   -5,  -1,  -8,   //
-    13,  8,   8,   10,  13,  0,   2,   -7,   //
-    0,   0,   0,   0,   0,   0,   0,   0};
-
-static constexpr int KNIGHT_SQ_VALUE[64] = {
-    -50, -40, -30, -30, -30, -30, -40, -50,  //
-    -40, -20, 0,   0,   0,   0,   -20, -40,  //
-    -30, 0,   10,  15,  15,  10,  0,   -30,  //
-    -30, 5,   15,  20,  20,  15,  5,   -30,  //
-    -30, 0,   15,  20,  20,  15,  0,   -30,  //
-    -30, 5,   10,  15,  15,  10,  5,   -30,  //
-    -40, -20, 0,   5,   5,   0,   -20, -40,  //
-    -50, -40, -30, -30, -30, -30, -40, -50,
-};
-
-static constexpr int BISHOP_SQ_VALUE[64] = {
-    -20, -10, -10, -10, -10, -10, -10, -20,  //
-    -10, 0,   0,   0,   0,   0,   0,   -10,  //
-    -10, 0,   5,   10,  10,  5,   0,   -10,  //
-    -10, 5,   5,   10,  10,  5,   5,   -10,  //
-    -10, 0,   10,  10,  10,  10,  0,   -10,  //
-    -10, 10,  10,  10,  10,  10,  10,  -10,  //
-    -10, 5,   0,   0,   0,   0,   5,   -10,  //
-    -20, -10, -10, -10, -10, -10, -10, -20,
-};
-
-static constexpr int ROOK_SQ_VALUE[64] = {0,  0,  0,  0,  0,  0,  0,  0,   //
-                                          5,  10, 10, 10, 10, 10, 10, 5,   //
-                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
-                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
-                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
-                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
-                                          -5, 0,  0,  0,  0,  0,  0,  -5,  //
-                                          0,  0,  0,  5,  5,  0,  0,  0};
-
-static constexpr int QUEEN_SQ_VALUE[64] = {
-    -20, -10, -10, -5, -5, -10, -10, -20,  //
-    -10, 0,   0,   0,  0,  0,   0,   -10,  //
-    -10, 0,   5,   5,  5,  5,   0,   -10,  //
-    -5,  0,   5,   5,  5,  5,   0,   -5,   //
-    0,   0,   5,   5,  5,  5,   0,   -5,   //
-    -10, 5,   5,   5,  5,  5,   0,   -10,  //
-    -10, 0,   5,   0,  0,  0,   0,   -10,  //
-    -20, -10, -10, -5, -5, -10, -10, -20};
-
-static constexpr int KING_OPENING_SQ_VALUE[64] = {
-    -40, -40, -40, -40, -40, -40, -40, -40,  //
-    -40, -40, -40, -40, -40, -40, -40, -40,  //
-    -40, -40, -40, -40, -40, -40, -40, -40,  //
-    -40, -40, -40, -40, -40, -40, -40, -40,  //
-    -40, -40, -40, -40, -40, -40, -40, -40,  //
-    -40, -40, -40, -40, -40, -40, -40, -40,  //
-    -20, -20, -20, -20, -20, -20, -20, -20,  //
-    0,   20,  40,  -20, 0,   -20, 40,  20};
-
-static constexpr int KING_ENDGAME_SQ_VALUE[64] = {
-    0,  10, 20, 30, 30, 20, 10, 0,   //
-    10, 20, 30, 40, 40, 30, 20, 10,  //
-    20, 30, 40, 50, 50, 40, 30, 20,  //
-    30, 40, 50, 60, 60, 50, 40, 30,  //
-    30, 40, 50, 60, 60, 50, 40, 30,  //
-    20, 30, 40, 50, 50, 40, 30, 20,  //
-    10, 20, 30, 40, 40, 30, 20, 10,  //
-    0,  10, 20, 30, 30, 20, 10, 0};
-
-static std::map<PackedBoard, int> board_repetition = {};
-int time_remaining_ms = 0;
-int total_time_used_ms = 0;
+// Occurrences of each position in the game and the current search line,
+// keyed by zobrist hash.
+thread_local std::map<std::uint64_t, int> board_repetition = {};
+thread_local int time_remaining_ms = 0;
+thread_local int total_time_used_ms = 0;
 
 // Move score from attacker to victim
 // PAWN KNIGHT BISHOP ROOK QUEEN KING
@@ -318,8 +50,23 @@ static constexpr int MVV_LVA[6][6] = {{105, 205, 305, 405, 505, 605},  //
                                       {101, 201, 301, 401, 501, 601},  //
                                       {100, 200, 300, 400, 500, 600}};
 
-void Seen(const Board &board) {
-  auto key = Board::Compact::encode(board);
+// Material value by piece type, used by the pruning margins.
+static constexpr int PIECE_VALUE[6] = {100, 320, 330, 500, 900, 0};
+
+// Forward pruning margins, in centipawns.
+// Reverse futility: prune when static eval - RFP_MARGIN * depth >= beta.
+static constexpr int RFP_DEPTH = 6;
+static constexpr int RFP_MARGIN = 80;
+// Futility: skip quiet moves when static eval + margin <= alpha.
+static constexpr int FUTILITY_DEPTH = 3;
+static constexpr int FUTILITY_MARGIN[FUTILITY_DEPTH + 1] = {0, 150, 300, 450};
+// Razoring: drop into quiescence when static eval + margin < alpha.
+static constexpr int RAZOR_DEPTH = 2;
+static constexpr int RAZOR_MARGIN[RAZOR_DEPTH + 1] = {0, 300, 550};
+// Delta: skip captures that cannot raise alpha even with this much to spare.
+static constexpr int DELTA_MARGIN = 200;
+
+void Seen(std::uint64_t key) {
   auto it = board_repetition.find(key);
   if (it == board_repetition.end()) {
     board_repetition[key] = 1;
@@ -328,8 +75,7 @@ void Seen(const Board &board) {
   (it->second)++;
 }
 
-void Unseen(const Board &board) {
-  auto key = Board::Compact::encode(board);
+void Unseen(std::uint64_t key) {
   auto it = board_repetition.find(key);
   if (it == board_repetition.end()) {
     return;
@@ -342,8 +88,8 @@ void Unseen(const Board &board) {
 }
 
 // Returns true if when the board is reached, it's a three fold repetition.
-bool IsThreeFoldRepetition(const Board &board) {
-  auto key = Board::Compact::encode(board);
+bool IsThreeFoldRepetition(std::uint64_t key) {
+  CountStat(&SearchStats::repetition_lookups);
   auto it = board_repetition.find(key);
   if (it == board_repetition.end()) {
     return false;
@@ -352,139 +98,305 @@ bool IsThreeFoldRepetition(const Board &board) {
   return false;
 }
 
-int Evaluate(const Board &board) {
-  int opening_eval = 0;
-  int endgame_eval = 0;
-  int base_eval = 0;
-  int num_pieces = 0;
-  for (auto c : {Color::WHITE, Color::BLACK}) {
-    auto king = board.pieces(PieceType::KING, c);
-    auto queens = board.pieces(PieceType::QUEEN, c);
-    auto rooks = board.pieces(PieceType::ROOK, c);
-    auto bishops = board.pieces(PieceType::BISHOP, c);
-    auto knights = board.pieces(PieceType::KNIGHT, c);
-    auto pawns = board.pieces(PieceType::PAWN, c);
-
-    int sign = (c == Color::WHITE) ? 1 : -1;
-    // pieces bitboard is copied
-    auto f = [&num_pieces, &c, &sign](int &target, auto pieces, auto sq_value,
-                                      int value) {
-      while (pieces) {
-        num_pieces++;
-        auto sq = pieces.pop();
-        if (c == Color::WHITE)
-          sq = WHITE_SQ_INDEX[sq];
-        else
-          sq = BLACK_SQ_INDEX[sq];
-        target += (value + sq_value[sq]) * sign;
-        // target += value * sign;
-      }
-    };
-    f(base_eval, queens, QUEEN_SQ_VALUE, 900);
-    f(base_eval, rooks, ROOK_SQ_VALUE, 500);
-    f(base_eval, bishops, BISHOP_SQ_VALUE, 330);
-    f(base_eval, knights, KNIGHT_SQ_VALUE, 320);
-    f(opening_eval, pawns, PAWN_OPENING_SQ_VALUE, 100);
-    f(endgame_eval, pawns, PAWN_ENDGAME_SQ_VALUE, 100);
-    f(opening_eval, king, KING_OPENING_SQ_VALUE, 20000);
-    f(endgame_eval, king, KING_ENDGAME_SQ_VALUE, 20000);
-
-    auto pawn_position_value = [&board, &c, &sign](int &target,
-                                                   Bitboard pawns) {
-      uint64_t our_pawns = board.pieces(PieceType::PAWN, c).getBits();
-      uint64_t their_pawns = board.pieces(PieceType::PAWN, ~c).getBits();
-      while (pawns) {
-        Square sq = pawns.pop();
-        // Double pawn
-        uint64_t double_pawns = FILE_MASK[sq.index()] & our_pawns;
-        bool not_double =
-            (double_pawns & (double_pawns - 1)) == 0 && double_pawns != 0;
-        if (!not_double) {
-          // std::cout << "applying double pawn penalty" << std::endl;
-          target += DOUBLE_PAWN_PENALTY * sign;
-        }
+// Static evals, direct-mapped on the zobrist hash. Quiescence reaches the
+// same positions through different capture orders, and negamax evaluates
+// nodes that its null move and razoring searches evaluate again. Entries
+// hold the side-relative eval and stay valid across searches. 8 bytes per
+// entry, 256 KB in total.
+struct EvalEntry {
+  std::uint32_t key;
+  std::int16_t eval;
+  // False when eval only has the material terms, see StaticEval().
+  bool full;
+};
 
-        // Isolated pawn
-        uint64_t neighbor_pawns = ISOLATED_PAWN_MASK[sq.index()] & our_pawns;
-        // std::cout << Bitboard(isolated_pawns) << std::endl;
-        if (neighbor_pawns == 0) {
-          // std::cout << "applying isolated pawn penalty" << std::endl;
-          target += ISOLATED_PAWN_PENALTY * sign;
-        }
+static constexpr int EVAL_CACHE_SIZE = 1 << 15;
+thread_local EvalEntry eval_cache[EVAL_CACHE_SIZE];
+thread_local int eval_cache_probes;
+thread_local int eval_cache_hits;
+
+// Lazy evaluation: the structure terms are skipped when the material terms
+// alone are this far above beta. Below alpha the eval still feeds delta
+// pruning, so it is always computed in full there.
+static constexpr int LAZY_EVAL_MARGIN = 150;
+thread_local int lazy_evals;
+thread_local int lazy_eval_skips;
+
+// Evaluate() from the side to move's point of view, through the cache. With
+// a beta, the structure terms are only added when the material terms are
+// below beta + LAZY_EVAL_MARGIN; otherwise the material terms alone are
+// returned, and cached as such.
+int StaticEval(const SearchPosition &board, int beta = INF) {
+  EvalEntry &entry = eval_cache[board.hash() & (EVAL_CACHE_SIZE - 1)];
+  auto key = static_cast<std::uint32_t>(board.hash() >> 32);
+  bool lazy = beta != INF;
+  eval_cache_probes++;
+  lazy_evals += lazy;
+  auto above_beta = [&](int eval) {
+    return lazy && eval - LAZY_EVAL_MARGIN >= beta;
+  };
+  if (entry.key == key && (entry.full || above_beta(entry.eval))) {
+    eval_cache_hits++;
+    lazy_eval_skips += !entry.full;
+    return entry.eval;
+  }
 
-        // Passed pawn
-        uint64_t passed_pawn_blocker =
-            ((c == Color::WHITE) ? WHITE_PASSED_PAWN_MASK[sq.index()]
-                                 : BLACK_PASSED_PAWN_MASK[sq.index()]) &
-            their_pawns;
-        if (passed_pawn_blocker == 0) {
-          int bonus = (c == Color::WHITE ? WHITE_PASSED_PAWN_BONUS[sq.rank()]
-                                         : BLACK_PASSED_PAWN_BONUS[sq.rank()]);
-          // std::cout << "applying passed pawn bonus " << bonus << std::endl;
-          target += bonus * sign;
-        }
-      }
-    };
+  ScopedTimer timer(Timer::EVAL);
+  int sign = (board.sideToMove() == Color::WHITE) ? 1 : -1;
+  EvalTerms terms;
+  AddMaterialTerms(board, terms);
+  int eval = terms.Blend() * sign;
+  bool full = !above_beta(eval);
+  if (full) {
+    AddStructureTerms(board, terms);
+    eval = terms.Blend() * sign;
+  } else {
+    lazy_eval_skips++;
+  }
+  entry = {key, static_cast<std::int16_t>(eval), full};
+  return eval;
+}
 
-    pawn_position_value(base_eval, pawns);
+// Hash table of best moves, used for move ordering and singular extensions.
+// It is not used for cutoffs. 12 bytes per entry, 384 KB in total.
+enum class Bound : std::uint8_t { NONE, UPPER, LOWER, EXACT };
 
-    auto king_safety_value = [&board, &c, &sign](int &target, Bitboard king) {
-      while (king) {
-        auto sq = king.pop();
-        Bitboard occ = board.us(c);
-        Bitboard occ_their = board.us(~c);
-        Bitboard neighbor = attacks::king(sq) & occ;
-        Bitboard neighbor_their = attacks::king(sq) & occ_their;
-        target += (neighbor.count() - neighbor_their.count()) * 15 * sign;
-      }
-    };
-    king_safety_value(opening_eval, king);
+struct HashEntry {
+  std::uint32_t key;
+  std::int32_t score;
+  std::uint16_t move;
+  std::int8_t depth;
+  Bound bound;
+};
+
+static constexpr int HASH_TABLE_SIZE = 1 << 15;
+thread_local HashEntry hash_table[HASH_TABLE_SIZE];
+
+// Returns the entry for the board, or nullptr if the slot holds another
+// position.
+const HashEntry *ProbeHash(const SearchPosition &board) {
+  const HashEntry &entry = hash_table[board.hash() & (HASH_TABLE_SIZE - 1)];
+  if (entry.bound == Bound::NONE ||
+      entry.key != static_cast<std::uint32_t>(board.hash() >> 32)) {
+    return nullptr;
   }
-  float phase = num_pieces / 32.0f;
-  return base_eval + opening_eval * phase + (1 - phase) * endgame_eval;
+  return &entry;
 }
 
-Move killer_moves[2][64];
-int history_moves_score[12][64];
-Move pv_table[2][64][64];
+// Quiet move history. Entries are updated with a "gravity" formula so they
+// saturate at +/-HISTORY_MAX instead of growing without bound, which keeps the
+// combined ordering score inside Move::score() (int16) and below the killers.
+static constexpr int HISTORY_MAX = 8192;
+static constexpr int HISTORY_BONUS_MAX = 1200;
+
+// Butterfly history, indexed by [piece][to].
+thread_local int history_moves_score[12][64];
+// Reply to the previous move, indexed by the previous [piece][to].
+thread_local Move counter_moves[12][64];
+// Continuation history, indexed by a previous [piece][to] (one or two plies
+// back) and the current [piece][to]. int16 keeps it at ~1.2 MB.
+thread_local std::int16_t continuation_history[12][64][12][64];
+
+// Late move reduction in plies, indexed by [depth][moves searched]. Grows with
+// the log of both so late moves at high depth are reduced the most.
+static const auto REDUCTIONS = [] {
+  std::array<std::array<int, 256>, 64> table{};
+  for (int depth = 1; depth < 64; ++depth) {
+    for (int moves = 1; moves < 256; ++moves) {
+      table[depth][moves] =
+          static_cast<int>(0.75 + std::log(depth) * std::log(moves) / 2.25);
+    }
+  }
+  return table;
+}();
+
+// Late move pruning: at depth <= LMP_DEPTH quiet moves after this many moves
+// searched are skipped, indexed by [improving][depth].
+static constexpr int LMP_DEPTH = 3;
+static constexpr int LMP_MOVE_COUNT[2][LMP_DEPTH + 1] = {{0, 2, 4, 7},
+                                                         {0, 4, 7, 12}};
+
+// Deepest ply the search reaches, quiescence included.
+static constexpr int MAX_PLY = 128;
+
+// Per-ply search state. Entries are indexed by ply with two sentinel entries
+// in front, so a node at any ply can look at ss - 1 and ss - 2.
+struct SearchStack {
+  // Principal variation from this ply.
+  int pv_length;
+  Move pv[MAX_PLY];
+  Move killers[2];
+  // Side-relative static eval, NINF when in check.
+  int static_eval;
+  // Move played from this ply and the piece that moved. Piece::NONE marks a
+  // null move or no move.
+  Move current_move;
+  Piece moved_piece;
+  // Move skipped by a singular extension verification search.
+  Move excluded_move;
+  bool null_move;
+};
+
+thread_local SearchStack search_stack[MAX_PLY + 4];
+
+// Principal variation of the last completed iteration.
+thread_local Move root_pv[MAX_PLY];
+thread_local int root_pv_length;
+
+thread_local int ply = 0;
+
+SearchStack *CurrentStack() { return &search_stack[ply + 2]; }
+
+// Position at each ply. Moves are made by copying the parent position into
+// the next slot, so nothing has to be undone.
+thread_local SearchPosition positions[MAX_PLY + 1];
+thread_local int nodes;
+// The search stops like at the deadline once it has searched this many nodes.
+thread_local int node_limit = std::numeric_limits<int>::max();
+thread_local bool follow_pv;
+
+// The engine is meant to run in 5 MiB (see README). Every search thread has
+// its own copy of the thread_local tables above, about 1.9 MB, so the batch
+// modes run at most as many search threads as fit in the budget.
+static constexpr std::size_t MEMORY_BUDGET = 5 << 20;
+static constexpr std::size_t SEARCH_THREAD_BYTES =
+    sizeof(eval_cache) + sizeof(hash_table) + sizeof(history_moves_score) +
+    sizeof(counter_moves) + sizeof(continuation_history) +
+    sizeof(search_stack) + sizeof(root_pv) + sizeof(positions) +
+    sizeof(search_stats);
+static constexpr int MAX_SEARCH_THREADS =
+    std::max<int>(1, MEMORY_BUDGET / SEARCH_THREAD_BYTES);
+
+// `requested` threads, lowered to MAX_SEARCH_THREADS with a note if needed.
+int SearchThreads(int requested) {
+  int threads = std::clamp(requested, 1, MAX_SEARCH_THREADS);
+  if (threads < requested) {
+    std::cerr << "threads " << requested << " lowered to " << threads
+              << ", each search thread takes " << SEARCH_THREAD_BYTES / 1024
+              << " KB of the " << MEMORY_BUDGET / 1024 << " KB budget"
+              << std::endl;
+  }
+  return threads;
+}
 
-Move (*cur_pv_table)[64][64];
-Move (*prev_pv_table)[64][64];
+// Mate scores are stored relative to the node rather than the root.
+int ScoreToHash(int score) {
+  if (score >= MATE_BOUND) return score + ply;
+  if (score <= -MATE_BOUND) return score - ply;
+  return score;
+}
 
-int ply = 0;
-int nodes;
-bool follow_pv;
+int ScoreFromHash(int score) {
+  if (score >= MATE_BOUND) return score - ply;
+  if (score <= -MATE_BOUND) return score + ply;
+  return score;
+}
+
+void StoreHash(const SearchPosition &board, int depth, int score, Bound bound,
+               Move move) {
+  HashEntry &entry = hash_table[board.hash() & (HASH_TABLE_SIZE - 1)];
+  auto key = static_cast<std::uint32_t>(board.hash() >> 32);
+  if (entry.key == key) {
+    // Keep the deeper result for the same position, and its move if we
+    // have none.
+    if (bound != Bound::EXACT && depth < entry.depth) return;
+    if (move == Move::NO_MOVE) move = entry.move;
+  }
+  entry.key = key;
+  entry.score = ScoreToHash(score);
+  entry.move = move.move();
+  entry.depth = depth;
+  entry.bound = bound;
+}
+
+// Aspiration window failures in the current search.
+thread_local int aspiration_fail_lows;
+thread_local int aspiration_fail_highs;
+
+// Aspiration windows start ASPIRATION_DELTA plus the recent score swing wide
+// around the previous score, and double on the side that failed. Once wider
+// than ASPIRATION_MAX_DELTA the window is opened fully.
+static constexpr int ASPIRATION_MIN_DEPTH = 4;
+static constexpr int ASPIRATION_DELTA = 25;
+static constexpr int ASPIRATION_MAX_DELTA = 500;
 
 void PrevPvToStderr() {
-  for (int i = 0; i < 64; ++i) {
-    const Move &move = (*prev_pv_table)[0][i];
-    if (move == Move::NO_MOVE) return;
+  for (int i = 0; i < root_pv_length; ++i) {
     if (i != 0) std::cerr << " ";
-    std::cerr << uci::moveToUci(move);
+    std::cerr << uci::moveToUci(root_pv[i]);
+  }
+}
+
+// Continuation history entry for playing `piece` to `to`, given the move
+// played `back` plies earlier. Returns nullptr when there is no such move.
+std::int16_t *ContinuationHistory(int back, Piece piece, Square to) {
+  const SearchStack *prev = CurrentStack() - back;
+  if (prev->moved_piece == Piece::NONE) return nullptr;
+  return &continuation_history[prev->moved_piece]
+                              [prev->current_move.to().index()][piece]
+                              [to.index()];
+}
+
+Move CounterMove() {
+  const SearchStack *prev = CurrentStack() - 1;
+  if (prev->moved_piece == Piece::NONE) return Move::NO_MOVE;
+  return counter_moves[prev->moved_piece][prev->current_move.to().index()];
+}
+
+int QuietHistory(const SearchPosition &board, const Move &move) {
+  Piece piece = board.at(move.from());
+  int score = history_moves_score[piece][move.to().index()];
+  for (int back : {1, 2}) {
+    auto *entry = ContinuationHistory(back, piece, move.to());
+    if (entry != nullptr) score += *entry;
   }
+  return score;
 }
 
-void ScoreMove(const Board &board, Move &move) {
+void UpdateHistoryEntry(int &entry, int bonus) {
+  entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+}
+
+void UpdateHistoryEntry(std::int16_t &entry, int bonus) {
+  int value = entry;
+  UpdateHistoryEntry(value, bonus);
+  entry = value;
+}
+
+// Rewards `move` by `bonus` (negative for a malus) in the butterfly and
+// continuation history tables.
+void UpdateQuietHistory(const SearchPosition &board, const Move &move, int bonus) {
+  Piece piece = board.at(move.from());
+  UpdateHistoryEntry(history_moves_score[piece][move.to().index()], bonus);
+  for (int back : {1, 2}) {
+    auto *entry = ContinuationHistory(back, piece, move.to());
+    if (entry != nullptr) UpdateHistoryEntry(*entry, bonus);
+  }
+}
+
+void ScoreMove(const SearchPosition &board, Move &move) {
   auto attacker_type = board.at<PieceType>(move.from());
   auto target_sq = move.to();
   if (board.isCapture(move)) {
     auto victim_type = board.at<PieceType>(target_sq);
     move.setScore(MVV_LVA[attacker_type][victim_type] + 10000);
-  } else if (killer_moves[0][ply] == move) {
+  } else if (CurrentStack()->killers[0] == move) {
     move.setScore(9000);
-  } else if (killer_moves[1][ply] == move) {
+  } else if (CurrentStack()->killers[1] == move) {
     move.setScore(8000);
+  } else if (CounterMove() == move) {
+    move.setScore(7500);
   } else {
-    int piece_index = board.sideToMove() * 6 + attacker_type;
-    move.setScore(history_moves_score[piece_index][target_sq.index()]);
+    // Three tables of at most HISTORY_MAX each, scaled below the counter move.
+    move.setScore(QuietHistory(board, move) / 4);
   }
 }
 
-void ScoreMoves(const Board &board, Movelist &moves) {
+void ScoreMoves(const SearchPosition &board, Movelist &moves) {
   Move *pv_move = nullptr;
   for (auto &move : moves) {
     ScoreMove(board, move);
-    if (move == (*cur_pv_table)[0][ply]) pv_move = &move;
+    if (ply < root_pv_length && move == root_pv[ply]) pv_move = &move;
   }
   if (follow_pv) {
     if (pv_move == nullptr) {
@@ -498,17 +410,186 @@ void ScoreMoves(const Board &board, Movelist &moves) {
   }
 }
 
-int quiescence(Board &board, int alpha, int beta,
+void SortMoves(Movelist &moves) {
+  CountStat(&SearchStats::sorts);
+  CountStat(&SearchStats::sorted_moves, moves.size());
+  std::sort(moves.begin(), moves.end(),
+            [](const Move &a, const Move &b) { return a.score() > b.score(); });
+}
+
+// Attack data of a node, each part computed on first use and then shared by
+// move generation, legality checks of stored moves and the search's check
+// tests.
+class NodeInfo {
+ public:
+  explicit NodeInfo(const SearchPosition &board) : board_(board) {}
+
+  // Check and pin masks and the squares the opponent attacks.
+  const movegen::NodeInfo &Masks() {
+    if (!has_masks_) {
+      masks_ = movegen::nodeInfo(board_);
+      has_masks_ = true;
+    }
+    return masks_;
+  }
+
+  // Squares from which each of our piece types would check the opponent.
+  const movegen::CheckInfo &CheckSquares() {
+    if (!has_check_squares_) {
+      check_squares_ = movegen::checkInfo(board_);
+      has_check_squares_ = true;
+    }
+    return check_squares_;
+  }
+
+  bool InCheck() { return Masks().checks > 0; }
+  bool GivesCheck(Move move) { return board_.givesCheck(move, CheckSquares()); }
+
+ private:
+  const SearchPosition &board_;
+  bool has_masks_ = false;
+  bool has_check_squares_ = false;
+  movegen::NodeInfo masks_;
+  movegen::CheckInfo check_squares_;
+};
+
+// Hands out the moves of a node in order: PV move, hash move, captures by
+// MVV-LVA, killers, counter move, then the other quiet moves by history.
+// The moves before the captures are validated on their own, so a node that
+// cuts on one of them never generates moves.
+class MovePicker {
+ public:
+  MovePicker(const SearchPosition &board, NodeInfo &node, Move hash_move)
+      : board_(board), node_(node), hash_move_(hash_move) {}
+
+  // Returns the next legal move, or Move::NO_MOVE when there is none left.
+  Move Next() {
+    for (;;) {
+      switch (stage_) {
+        case Stage::PV: {
+          stage_ = Stage::HASH;
+          if (!follow_pv) break;
+          Move pv_move = ply < root_pv_length ? root_pv[ply] : Move::NO_MOVE;
+          if (IsLegal(pv_move)) return Emit(pv_move);
+          follow_pv = false;
+          break;
+        }
+        case Stage::HASH:
+          stage_ = Stage::GENERATE_CAPTURES;
+          if (!Tried(hash_move_) && IsLegal(hash_move_)) {
+            return Emit(hash_move_);
+          }
+          break;
+        case Stage::GENERATE_CAPTURES:
+          Generate<movegen::MoveGenType::CAPTURE>();
+          stage_ = Stage::CAPTURES;
+          break;
+        case Stage::CAPTURES:
+          if (Move move = NextGenerated(); move != Move::NO_MOVE) return move;
+          stage_ = Stage::KILLER_1;
+          break;
+        case Stage::KILLER_1:
+        case Stage::KILLER_2:
+        case Stage::COUNTER: {
+          Move move = stage_ == Stage::COUNTER ? CounterMove()
+                      : stage_ == Stage::KILLER_1 ? CurrentStack()->killers[0]
+                                                  : CurrentStack()->killers[1];
+          stage_ = static_cast<Stage>(static_cast<int>(stage_) + 1);
+          // Stored moves are quiet, but may be a capture here.
+          if (!Tried(move) && IsLegal(move) && !board_.isCapture(move)) {
+            return Emit(move);
+          }
+          break;
+        }
+        case Stage::GENERATE_QUIETS:
+          Generate<movegen::MoveGenType::QUIET>();
+          stage_ = Stage::QUIETS;
+          break;
+        case Stage::QUIETS:
+          if (Move move = NextGenerated(); move != Move::NO_MOVE) return move;
+          stage_ = Stage::DONE;
+          break;
+        case Stage::DONE:
+          return Move::NO_MOVE;
+      }
+    }
+  }
+
+ private:
+  enum class Stage {
+    PV,
+    HASH,
+    GENERATE_CAPTURES,
+    CAPTURES,
+    KILLER_1,
+    KILLER_2,
+    COUNTER,
+    GENERATE_QUIETS,
+    QUIETS,
+    DONE
+  };
+
+  bool IsLegal(Move move) const {
+    return board_.isPseudoLegal(move) && board_.isLegal(move, node_.Masks());
+  }
+
+  bool Tried(Move move) const {
+    return std::find(tried_, tried_ + num_tried_, move) != tried_ + num_tried_;
+  }
+
+  Move Emit(Move move) {
+    tried_[num_tried_++] = move;
+    return move;
+  }
+
+  template <movegen::MoveGenType mt>
+  void Generate() {
+    CountMovegen(static_cast<int>(mt));
+    {
+      ScopedTimer timer(Timer::MOVEGEN);
+      moves_.clear();
+      movegen::legalmoves<mt>(moves_, board_, node_.Masks());
+    }
+    ScopedTimer timer(Timer::ORDERING);
+    for (auto &move : moves_) ScoreMove(board_, move);
+    SortMoves(moves_);
+    index_ = 0;
+  }
+
+  // Next generated move not handed out by an earlier stage.
+  Move NextGenerated() {
+    while (index_ < moves_.size()) {
+      Move move = moves_[index_++];
+      if (!Tried(move)) return move;
+    }
+    return Move::NO_MOVE;
+  }
+
+  const SearchPosition &board_;
+  NodeInfo &node_;
+  Move hash_move_;
+  Stage stage_ = Stage::PV;
+  // PV, hash, two killers and counter move.
+  Move tried_[5];
+  int num_tried_ = 0;
+  Movelist moves_;
+  int index_ = 0;
+};
+
+int quiescence(const SearchPosition &board, int alpha, int beta,
                const std::chrono::time_point<std::chrono::high_resolution_clock>
                    &deadline) {
-  if (std::chrono::high_resolution_clock::now() > deadline) {
-    throw "Deadline passed";
+  if (nodes >= node_limit ||
+      std::chrono::high_resolution_clock::now() > deadline) {
+    throw "Search limit reached";
   }
 
   nodes++;
+  CountStat(&SearchStats::qsearch_nodes);
+  CurrentStack()->pv_length = 0;
 
-  int eval =
-      (board.sideToMove() == Color::WHITE) ? Evaluate(board) : -Evaluate(board);
+  int eval = StaticEval(board, beta);
+  if (ply >= MAX_PLY - 1) return eval;
   if (eval >= beta) {
     return beta;
   }
@@ -517,17 +598,41 @@ int quiescence(Board &board, int alpha, int beta,
   }
 
   Movelist moves;
-  movegen::legalmoves<movegen::MoveGenType::CAPTURE>(moves, board);
-  ScoreMoves(board, moves);
-  std::sort(moves.begin(), moves.end(),
-            [](const Move &a, const Move &b) { return a.score() > b.score(); });
+  CountMovegen(static_cast<int>(movegen::MoveGenType::CAPTURE));
+  {
+    ScopedTimer timer(Timer::MOVEGEN);
+    movegen::legalmoves<movegen::MoveGenType::CAPTURE>(moves, board);
+  }
+  {
+    ScopedTimer timer(Timer::ORDERING);
+    ScoreMoves(board, moves);
+    SortMoves(moves);
+  }
 
+  // Delta pruning
+  int stand_pat = eval;
+  bool delta_pruning = std::abs(alpha) < MATE_BOUND;
   for (const auto &move : moves) {
-    board.makeMove(move);
+    if (delta_pruning && move.typeOf() != Move::PROMOTION) {
+      auto victim_type = move.typeOf() == Move::ENPASSANT
+                             ? PieceType(PieceType::PAWN)
+                             : board.at<PieceType>(move.to());
+      if (stand_pat + PIECE_VALUE[victim_type] + DELTA_MARGIN <= alpha) {
+        continue;
+      }
+    }
+
+    CurrentStack()->current_move = move;
+    CurrentStack()->moved_piece = board.at(move.from());
+    SearchPosition &child = positions[ply + 1];
+    {
+      ScopedTimer timer(Timer::MAKE_MOVE);
+      child = board;
+      child.makeMove(move);
+    }
     ply++;
-    eval = -quiescence(board, -beta, -alpha, deadline);
+    eval = -quiescence(child, -beta, -alpha, deadline);
     ply--;
-    board.unmakeMove(move);
     if (eval >= beta) {
       return beta;
     }
@@ -539,146 +644,442 @@ int quiescence(Board &board, int alpha, int beta,
   return alpha;
 }
 
-bool in_null_move_reduction = false;
-
-int negamax(Board &board, int depth, int alpha, int beta,
+// Singular extensions: the hash move is extended by one ply when no other
+// move reaches SE_MARGIN * depth below its hashed score. If the reduced
+// search shows that other moves beat beta too, the node is cut (multi-cut).
+static constexpr int SE_MIN_DEPTH = 8;
+static constexpr int SE_MARGIN = 2;
+static constexpr int SE_HASH_DEPTH_SLACK = 3;
+
+// Nodes without a hash move or PV move to search first are reduced by one ply
+// from IIR_MIN_DEPTH (internal iterative reduction). With USE_IID they are
+// instead searched IID_REDUCTION plies shallower first at PV nodes, to fill
+// the hash table with a move to order first (internal iterative deepening).
+static constexpr int IIR_MIN_DEPTH = 4;
+static constexpr bool USE_IID = false;
+static constexpr int IID_MIN_DEPTH = 5;
+static constexpr int IID_REDUCTION = 3;
+
+// Null moves are disabled below this ply while a verification search runs.
+thread_local int null_move_min_ply = 0;
+
+// Null move pruning parameters. The reduction grows with depth and with how
+// far the static eval is above beta.
+static constexpr int NMP_MIN_DEPTH = 3;
+static constexpr int NMP_BASE_REDUCTION = 3;
+static constexpr int NMP_EVAL_DIVISOR = 200;
+// From this depth a cutoff is only trusted after a verification search.
+static constexpr int NMP_VERIFICATION_DEPTH = 10;
+
+int negamax(const SearchPosition &board, int depth, int alpha, int beta,
             const std::chrono::time_point<std::chrono::high_resolution_clock>
                 &deadline) {
   constexpr static int FULL_DEPTH_MOVE = 4;
   constexpr static int REDUCTION_LIMIT = 3;
 
-  if (std::chrono::high_resolution_clock::now() > deadline) {
-    throw "Deadline passed";
+  if (nodes >= node_limit ||
+      std::chrono::high_resolution_clock::now() > deadline) {
+    throw "Search limit reached";
   }
 
-  if (IsThreeFoldRepetition(board)) {
+  SearchStack *ss = CurrentStack();
+  ss->pv_length = 0;
+
+  if (IsThreeFoldRepetition(board.hash())) {
     return 0;
   }
-  if (depth == 0) {
+  if (depth <= 0) {
     return quiescence(board, alpha, beta, deadline);
   }
 
-  if (ply > 63) {
-    return (board.sideToMove() == Color::WHITE) ? Evaluate(board)
-                                                : -Evaluate(board);
+  if (ply >= MAX_PLY - 1) {
+    return StaticEval(board);
   }
 
   nodes++;
+  CountStat(&SearchStats::main_nodes);
+
+  NodeInfo node(board);
+  bool in_check = node.InCheck();
+  bool is_pv_node = beta - alpha > 1;
+  Move excluded_move = ss->excluded_move;
+
+  // Copied, the searches below may overwrite the slot with another position.
+  // Bound::NONE when there is no entry.
+  HashEntry hash_entry = {};
+  if (excluded_move == Move::NO_MOVE) {
+    if (const HashEntry *entry = ProbeHash(board)) hash_entry = *entry;
+  }
+  Move hash_move = Move(hash_entry.move);
 
-  bool in_check = board.inCheck();
-
-  // Null move reduction
-  if (!in_null_move_reduction && !follow_pv && depth >= 3 && !in_check && ply > 0) {
-    int static_eval = Evaluate(board);
-    if (static_eval >= beta) {
-      in_null_move_reduction = true;
-      board.makeNullMove();
-      int R = 2;
-      int score = -negamax(board, depth - 1 - R, -beta, -beta + 1, deadline);
-      board.unmakeNullMove();
-      in_null_move_reduction = false;
-      if (score >= beta) {
-        return beta;
-      }
-    }
+  int static_eval = NINF;
+  if (!in_check) {
+    static_eval = StaticEval(board);
+  }
+  ss->static_eval = static_eval;
+  bool improving =
+      !in_check && (ply < 2 || static_eval > (ss - 2)->static_eval);
+  bool can_prune = !is_pv_node && !in_check && ply > 0 &&
+                   std::abs(alpha) < MATE_BOUND && std::abs(beta) < MATE_BOUND;
+
+  // Reverse futility pruning
+  if (can_prune && depth <= RFP_DEPTH &&
+      static_eval - RFP_MARGIN * depth >= beta) {
+    return beta;
   }
 
-  // Score moves for better pruning.
-  Movelist moves;
-  movegen::legalmoves<movegen::MoveGenType::ALL>(moves, board);
-  ScoreMoves(board, moves);
-  std::sort(moves.begin(), moves.end(),
-            [](const Move &a, const Move &b) { return a.score() > b.score(); });
+  // Razoring
+  if (can_prune && depth <= RAZOR_DEPTH &&
+      static_eval + RAZOR_MARGIN[depth] < alpha) {
+    int score = quiescence(board, alpha, alpha + 1, deadline);
+    if (score <= alpha) return alpha;
+  }
 
-  if (moves.empty()) {
-    // Lose
-    if (in_check) return -999999 + ply;
-    // Draw
-    return 0;
+  // Futility pruning of quiet moves, applied in the move loop.
+  bool futile = can_prune && depth <= FUTILITY_DEPTH &&
+                static_eval + FUTILITY_MARGIN[depth] <= alpha;
+
+  // Null move pruning. Skipped after a null move, in pawn-only endings where
+  // zugzwang is likely, and below a verification search.
+  if (!follow_pv && can_prune && depth >= NMP_MIN_DEPTH &&
+      excluded_move == Move::NO_MOVE &&
+      static_eval >= beta && !(ss - 1)->null_move &&
+      ply >= null_move_min_ply &&
+      board.hasNonPawnMaterial(board.sideToMove())) {
+    int R = NMP_BASE_REDUCTION + depth / 3 +
+            std::min((static_eval - beta) / NMP_EVAL_DIVISOR, 3);
+    ss->null_move = true;
+    ss->current_move = Move::NULL_MOVE;
+    ss->moved_piece = Piece::NONE;
+    SearchPosition &child = positions[ply + 1];
+    {
+      ScopedTimer timer(Timer::MAKE_MOVE);
+      child = board;
+      child.makeNullMove();
+    }
+    ply++;
+    int score = -negamax(child, depth - 1 - R, -beta, -beta + 1, deadline);
+    ply--;
+    ss->null_move = false;
+    CountStat(&SearchStats::null_move_searches);
+    if (score >= beta) {
+      CountStat(&SearchStats::null_move_cutoffs);
+      if (depth < NMP_VERIFICATION_DEPTH) return beta;
+
+      // Verify with a reduced search of our own moves, with null moves
+      // disabled for the first part of it.
+      int saved_min_ply = null_move_min_ply;
+      null_move_min_ply = ply + 3 * (depth - R) / 4;
+      score = negamax(board, depth - R, beta - 1, beta, deadline);
+      null_move_min_ply = saved_min_ply;
+      if (score >= beta) return beta;
+    }
   }
 
-  bool found_pv = false;
+  // Internal iterative deepening / reduction
+  if (hash_move == Move::NO_MOVE && !follow_pv &&
+      excluded_move == Move::NO_MOVE) {
+    if (USE_IID && is_pv_node && depth >= IID_MIN_DEPTH) {
+      negamax(board, depth - IID_REDUCTION, alpha, beta, deadline);
+      if (const HashEntry *entry = ProbeHash(board)) {
+        hash_entry = *entry;
+        hash_move = Move(hash_entry.move);
+      }
+    } else if (depth >= IIR_MIN_DEPTH) {
+      depth--;
+    }
+  }
+
+  // Searches above at this ply may have left a pv behind.
+  ss->pv_length = 0;
+
+  int legal_moves = 0;
   int moves_searched = 0;
+  Move best_move = Move::NO_MOVE;
 
-  for (const auto &move : moves) {
-    board.makeMove(move);
-    Seen(board);
+  // Quiet moves searched so far, to be penalised if a later move cuts off.
+  Movelist quiets_searched;
+
+  MovePicker picker(board, node, hash_move);
+  for (Move move = picker.Next(); move != Move::NO_MOVE; move = picker.Next()) {
+    legal_moves++;
+    bool is_quiet = !board.isCapture(move) && move.typeOf() != Move::PROMOTION;
+
+    // Late move pruning
+    if (is_quiet && !is_pv_node && !in_check && depth <= LMP_DEPTH &&
+        moves_searched >= LMP_MOVE_COUNT[improving][depth]) {
+      continue;
+    }
+    if (futile && is_quiet && moves_searched > 0) continue;
+    if (move == excluded_move) continue;
+    int history = is_quiet ? QuietHistory(board, move) : 0;
+
+    // Singular extension
+    int extension = 0;
+    if (move == hash_move && depth >= SE_MIN_DEPTH && ply > 0 &&
+        hash_entry.bound != Bound::UPPER &&
+        hash_entry.depth >= depth - SE_HASH_DEPTH_SLACK) {
+      int hash_score = ScoreFromHash(hash_entry.score);
+      if (std::abs(hash_score) < MATE_BOUND) {
+        int singular_beta = hash_score - SE_MARGIN * depth;
+        // The verification search runs on this ply's stack entry, keep the
+        // pv found so far. It searches other moves than the pv one, so it
+        // must not follow the pv; the search of the pv move after it still
+        // does.
+        Move saved_pv[MAX_PLY];
+        int saved_pv_length = ss->pv_length;
+        std::copy(ss->pv, ss->pv + saved_pv_length, saved_pv);
+        bool saved_follow_pv = follow_pv;
+        follow_pv = false;
+        ss->excluded_move = move;
+        int score = negamax(board, (depth - 1) / 2, singular_beta - 1,
+                            singular_beta, deadline);
+        ss->excluded_move = Move::NO_MOVE;
+        follow_pv = saved_follow_pv;
+        std::copy(saved_pv, saved_pv + saved_pv_length, ss->pv);
+        ss->pv_length = saved_pv_length;
+        if (score < singular_beta) {
+          extension = 1;
+        } else if (singular_beta >= beta) {
+          // Multi-cut
+          return beta;
+        }
+      }
+    }
+    int new_depth = depth - 1 + extension;
+
+    ss->current_move = move;
+    ss->moved_piece = board.at(move.from());
+    SearchPosition &child = positions[ply + 1];
+    {
+      ScopedTimer timer(Timer::MAKE_MOVE);
+      child = board;
+      child.makeMove(move);
+    }
+    Seen(child.hash());
     ply++;
 
     // first move
     int eval = 0;
     if (moves_searched == 0) {
-      eval = -negamax(board, depth - 1, -beta, -alpha, deadline);
+      eval = -negamax(child, new_depth, -beta, -alpha, deadline);
     } else {
       auto full_depth_search = [&]() {
         // Principal variation search, mixed with last move reduction
-        eval = -negamax(board, depth - 1, -alpha - 1, -alpha, deadline);
+        eval = -negamax(child, new_depth, -alpha - 1, -alpha, deadline);
         if (eval > alpha && eval < beta) {
-          eval = -negamax(board, depth - 1, -beta, -alpha, deadline);
+          CountStat(&SearchStats::pvs_re_searches);
+          eval = -negamax(child, new_depth, -beta, -alpha, deadline);
         }
       };
-      // late move reduction
+      // Late move reduction, looked up by depth and move count and adjusted
+      // for node type, history and checks.
+      int reduction = 0;
       if (moves_searched >= FULL_DEPTH_MOVE && depth >= REDUCTION_LIMIT &&
-          !in_check) {
-        eval = -negamax(board, depth - 2, -alpha - 1, -alpha, deadline);
-        if (eval > alpha) full_depth_search();
+          is_quiet) {
+        reduction = REDUCTIONS[std::min(depth, 63)]
+                              [std::min(moves_searched, 255)];
+        if (is_pv_node) reduction--;
+        if (!improving) reduction++;
+        if (in_check || node.GivesCheck(move)) reduction--;
+        reduction -= history / 4096;
+        reduction = std::clamp(reduction, 0, depth - 2);
+      }
+      if (reduction > 0) {
+        CountStat(&SearchStats::lmr_searches);
+        eval = -negamax(child, new_depth - reduction, -alpha - 1, -alpha,
+                        deadline);
+        if (eval > alpha) {
+          CountStat(&SearchStats::lmr_re_searches);
+          full_depth_search();
+        }
       } else {
         full_depth_search();
       }
     }
 
     ply--;
-    Unseen(board);
-    board.unmakeMove(move);
+    Unseen(child.hash());
     moves_searched++;
     if (eval >= beta) {
-      if (!board.isCapture(move)) {
-        killer_moves[1][ply] = killer_moves[0][ply];
-        killer_moves[0][ply] = move;
+      CountStat(&SearchStats::beta_cutoffs);
+      if (moves_searched == 1) CountStat(&SearchStats::first_move_cutoffs);
+      if (is_quiet) {
+        if (ss->killers[0] != move) {
+          ss->killers[1] = ss->killers[0];
+          ss->killers[0] = move;
+        }
+        if ((ss - 1)->moved_piece != Piece::NONE) {
+          counter_moves[(ss - 1)->moved_piece]
+                       [(ss - 1)->current_move.to().index()] = move;
+        }
+        int bonus = std::min(depth * depth * 16, HISTORY_BONUS_MAX);
+        UpdateQuietHistory(board, move, bonus);
+        for (const auto &quiet : quiets_searched) {
+          UpdateQuietHistory(board, quiet, -bonus);
+        }
+      }
+      if (excluded_move == Move::NO_MOVE) {
+        StoreHash(board, depth, beta, Bound::LOWER, move);
       }
       return beta;
     }
+    if (is_quiet) quiets_searched.add(move);
     if (eval > alpha) {
-      if (!board.isCapture(move)) {
-        auto attacker_type = board.at<PieceType>(move.from());
-        int piece_index = board.sideToMove() * 6 + attacker_type;
-        history_moves_score[piece_index][move.to().index()] += depth;
-      }
       alpha = eval;
+      best_move = move;
 
-      found_pv = true;
-
-      (*cur_pv_table)[ply][ply] = move;
-      for (int next_ply = ply + 1; next_ply < 64; next_ply++) {
-        auto next = (*cur_pv_table)[ply + 1][next_ply];
-        if (next == Move::NO_MOVE) break;
-        (*cur_pv_table)[ply][next_ply] = next;
-      }
+      const SearchStack *child = ss + 1;
+      ss->pv[0] = move;
+      std::copy(child->pv, child->pv + child->pv_length, ss->pv + 1);
+      ss->pv_length = child->pv_length + 1;
     }
   }
+
+  if (legal_moves == 0) {
+    // Lose
+    if (in_check) return -MATE + ply;
+    // Draw
+    return 0;
+  }
+
+  if (excluded_move == Move::NO_MOVE) {
+    StoreHash(board, depth, alpha,
+              best_move == Move::NO_MOVE ? Bound::UPPER : Bound::EXACT,
+              best_move);
+  }
   return alpha;
 }
 
 void ResetGlobal() {
   nodes = 0;
   ply = 0;
-  for (int i = 0; i < 2; ++i) {
-    std::fill(killer_moves[i], killer_moves[i] + 64, Move::NO_MOVE);
-  }
-  for (int i = 0; i < 12; ++i) {
-    std::fill(history_moves_score[i], history_moves_score[i] + 64, 0);
+  aspiration_fail_lows = 0;
+  aspiration_fail_highs = 0;
+  ResetSearchStats();
+  eval_cache_probes = 0;
+  eval_cache_hits = 0;
+  lazy_evals = 0;
+  lazy_eval_skips = 0;
+  for (auto &entry : search_stack) {
+    entry.pv_length = 0;
+    entry.killers[0] = Move::NO_MOVE;
+    entry.killers[1] = Move::NO_MOVE;
+    entry.static_eval = NINF;
+    entry.current_move = Move::NO_MOVE;
+    entry.moved_piece = Piece::NONE;
+    entry.excluded_move = Move::NO_MOVE;
+    entry.null_move = false;
   }
-  for (int i = 0; i < 2; ++i) {
-    for (int j = 0; j < 64; ++j) {
-      std::fill(pv_table[i][j], pv_table[i][j] + 64, Move::NO_MOVE);
+  root_pv_length = 0;
+  null_move_min_ply = 0;
+  follow_pv = false;
+  node_limit = std::numeric_limits<int>::max();
+}
+
+// Deepest iteration of a timed search.
+static constexpr int MAX_SEARCH_DEPTH = 21;
+
+// Clears what earlier searches left in the hash table, eval cache and move
+// ordering tables, so the next search does not depend on them.
+void ClearSearchTables() {
+  std::memset(hash_table, 0, sizeof(hash_table));
+  std::memset(eval_cache, 0, sizeof(eval_cache));
+  std::memset(history_moves_score, 0, sizeof(history_moves_score));
+  std::memset(counter_moves, 0, sizeof(counter_moves));
+  std::memset(continuation_history, 0, sizeof(continuation_history));
+}
+
+// Outcome of an iterative deepening search.
+struct SearchResult {
+  // First move of the last completed iteration's pv, NO_MOVE if none
+  // completed.
+  Move best_move = Move::NO_MOVE;
+  // Side-relative score of the last completed iteration.
+  int eval = 0;
+  int depth = 0;
+};
+
+// Iterative deepening from positions[0] until max_depth is completed, the
+// deadline passes or node_limit nodes are searched. on_iteration, if given,
+// is called after every completed iteration.
+SearchResult IterativeDeepening(
+    int max_depth,
+    const std::chrono::time_point<std::chrono::high_resolution_clock>
+        &deadline,
+    const std::function<void(const SearchResult &)> &on_iteration = {}) {
+  auto eval = 0;
+  int completed_depth = 0;
+  // Backup three fold repetition tracker
+  std::map<std::uint64_t, int> board_repetition_cp = board_repetition;
+
+  // Iterative deepening
+  try {
+    // Running average of the score change between iterations.
+    int score_swing = 0;
+    for (; completed_depth < max_depth;) {
+      int depth = completed_depth + 1;
+      int delta = ASPIRATION_DELTA + score_swing;
+      int alpha = NINF;
+      int beta = INF;
+      if (depth >= ASPIRATION_MIN_DEPTH) {
+        alpha = std::max(eval - delta, NINF);
+        beta = std::min(eval + delta, INF);
+      }
+
+      // Aspiration window. Only the failing bound is widened, and a fail high
+      // is re-searched one ply shallower since the move is likely good anyway.
+      int search_depth = depth;
+      int score;
+      for (;;) {
+        follow_pv = 1;
+        score = negamax(positions[0], search_depth, alpha, beta, deadline);
+        if (score <= alpha && alpha != NINF) {
+          aspiration_fail_lows++;
+          alpha = std::max(score - delta, NINF);
+          search_depth = depth;
+        } else if (score >= beta && beta != INF) {
+          aspiration_fail_highs++;
+          beta = std::min(score + delta, INF);
+          search_depth = std::max(search_depth - 1, depth - 2);
+        } else {
+          break;
+        }
+        delta *= 2;
+        // The score is far off, e.g. a mate was found. Stop widening step by
+        // step and search the full window.
+        if (delta > ASPIRATION_MAX_DELTA) {
+          alpha = NINF;
+          beta = INF;
+        }
+      }
+      if (depth > 1) score_swing = (score_swing + std::abs(score - eval)) / 2;
+      eval = score;
+
+      // Increment depth
+      ++completed_depth;
+      // Keep the completed depth's pv to follow in the next depth.
+      root_pv_length = search_stack[2].pv_length;
+      std::copy(search_stack[2].pv, search_stack[2].pv + root_pv_length,
+                root_pv);
+      if (on_iteration) {
+        on_iteration(
+            {root_pv_length > 0 ? root_pv[0] : Move(Move::NO_MOVE), eval,
+             completed_depth});
+      }
     }
+  } catch (const char *msg) {
+    // Restore board_repetition, the search line was not unwound.
+    board_repetition = board_repetition_cp;
   }
-  follow_pv = false;
-  cur_pv_table = &pv_table[0];
-  prev_pv_table = &pv_table[1];
+
+  return {root_pv_length > 0 ? root_pv[0] : Move(Move::NO_MOVE), eval,
+          completed_depth};
 }
 
-void search(std::string &fen) {
+// Searches the position and plays the best move. With fixed_depth, searches
+// exactly that deep without a deadline (benchmarks).
+void search(std::string &fen, int fixed_depth = 0) {
   auto start = std::chrono::high_resolution_clock::now();
 
   ResetGlobal();
@@ -692,62 +1093,28 @@ void search(std::string &fen) {
     allocated_time = 90;
   }
   const std::chrono::time_point<std::chrono::high_resolution_clock> deadline =
-      start + std::chrono::milliseconds(allocated_time);
+      fixed_depth > 0
+          ? std::chrono::time_point<std::chrono::high_resolution_clock>::max()
+          : start + std::chrono::milliseconds(allocated_time);
+  int max_depth = fixed_depth > 0 ? fixed_depth : MAX_SEARCH_DEPTH;
 
   Board board = Board(fen);
   // Track the board state after the opponent played, for third fold repetition
   // check.
-  Seen(board);
+  Seen(board.hash());
+  positions[0] = SearchPosition(board);
 
-  auto eval = 0;
-  int completed_depth = 0;
-  // Backup three fold repetition tracker
-  std::map<PackedBoard, int> board_repetition_cp = board_repetition;
-
-  // Iterative deepening
-  try {
-    int alpha = NINF;
-    int beta = INF;
-    for (; completed_depth <= 20;) {
-      follow_pv = 1;
-      eval = negamax(board, completed_depth + 1, alpha, beta, deadline);
-
-      // Aspiration window
-      if (eval <= alpha || eval >= beta) {
-        // reset to full width window
-        // std::cerr << "aspiration window failed" << std::endl;
-        alpha = NINF;
-        beta = INF;
-        continue;
-      }
-      // Setup window for next depth.
-      static int ASPIRATION_WINDOW = 50;
-      alpha = eval - ASPIRATION_WINDOW;
-      beta = eval + ASPIRATION_WINDOW;
-
-      // Increment depth
-      ++completed_depth;
-      // Store completed depth pv_table, and prepare new one for next depth.
-      auto *temp = prev_pv_table;
-      prev_pv_table = cur_pv_table;
-      cur_pv_table = temp;
-    }
-  } catch (const char *msg) {
-    // Resetting the board, because of exception, board could have been in an
-    // inconsistent state
-    board = Board(fen);
-    // Restore board_repetition.
-    board_repetition = board_repetition_cp;
-  }
+  SearchResult result = IterativeDeepening(max_depth, deadline);
+  int eval = result.eval;
 
   auto end = std::chrono::high_resolution_clock::now();
 
-  auto best_move = (*prev_pv_table)[0][0];
+  auto best_move = result.best_move;
   if (best_move != Move::NO_MOVE) {
     std::cout << uci::moveToUci(best_move) << std::endl;
 
     board.makeMove(best_move);
-    Seen(board);
+    Seen(board.hash());
   } else {
     std::cout << "error" << std::endl;
   }
@@ -757,25 +1124,1064 @@ void search(std::string &fen) {
           .count();
   total_time_used_ms += duration_ms;
 
-  std::cerr << "iteration " << completed_depth << " eval "
+  std::cerr << "iteration " << result.depth << " eval "
             << std::showpos
             // We have made a move and the board is for the opponent so the eval
             // sign is flipped.
             << (board.sideToMove() == Color::WHITE ? -eval : eval)
             << std::noshowpos << " pv ";
   PrevPvToStderr();
-  std::cerr << " nodes " << nodes << " time " << duration_ms
+  std::cerr << " nodes " << nodes << " fail_low " << aspiration_fail_lows
+            << " fail_high " << aspiration_fail_highs << " eval_cache_hits "
+            << eval_cache_hits << "/" << eval_cache_probes << " lazy_eval_skips "
+            << lazy_eval_skips << "/" << lazy_evals << " time " << duration_ms
             << " milliseconds total_time " << total_time_used_ms << std::endl;
+  if constexpr (SEARCH_STATS_ENABLED) {
+    PrintSearchStats(std::cerr, result.depth, duration_ms);
+  }
+}
+
+// Leaf count through make/unmake, on Board (virtual piece hooks) or
+// PlainBoard (hooks inlined).
+template <typename BoardT>
+std::uint64_t PerftMakeUnmake(BoardT &board, int depth) {
+  Movelist moves;
+  movegen::legalmoves(moves, board);
+  if (depth == 1) return moves.size();
+  std::uint64_t count = 0;
+  for (const auto &move : moves) {
+    board.makeMove(move);
+    count += PerftMakeUnmake(board, depth - 1);
+    board.unmakeMove(move);
+  }
+  return count;
+}
+
+// Leaf count through SearchPosition copy-make, as done by the search.
+std::uint64_t PerftCopyMake(const SearchPosition &position, int depth) {
+  Movelist moves;
+  movegen::legalmoves(moves, position);
+  if (depth == 1) return moves.size();
+  std::uint64_t count = 0;
+  for (const auto &move : moves) {
+    SearchPosition &child = positions[ply + 1];
+    child = position;
+    child.makeMove(move);
+    ply++;
+    count += PerftCopyMake(child, depth - 1);
+    ply--;
+  }
+  return count;
+}
+
+// Times perft with each position representation.
+void PerftBenchmark(const std::string &fen, int depth) {
+  auto run = [&](const char *name, auto perft) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::uint64_t count = perft();
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+            .count();
+    std::cout << name << " nodes " << count << " time " << duration_ms
+              << " milliseconds nps "
+              << count * 1000 / std::max<std::int64_t>(duration_ms, 1)
+              << std::endl;
+    return count;
+  };
+  Board board(fen);
+  std::uint64_t expected =
+      run("make_unmake", [&] { return PerftMakeUnmake(board, depth); });
+  PlainBoard plain_board(fen);
+  std::uint64_t plain_count = run(
+      "make_unmake_plain", [&] { return PerftMakeUnmake(plain_board, depth); });
+  ply = 0;
+  positions[0] = SearchPosition(board);
+  std::uint64_t count =
+      run("copy_make", [&] { return PerftCopyMake(positions[0], depth); });
+  if (plain_count != expected || count != expected) {
+    std::cout << "mismatch" << std::endl;
+  }
+}
+
+// Positions searched by the benchmark: the perft suite's middlegames and an
+// endgame, plus a few quiet openings and middlegames.
+static const char *BENCH_FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+// Runs a benchmark phase and reports its hardware counters per node.
+template <typename F>
+void BenchPhase(PerfCounters &counters, const char *name, F run) {
+  auto start = std::chrono::high_resolution_clock::now();
+  counters.Start();
+  std::uint64_t count = run();
+  counters.Stop();
+  auto end = std::chrono::high_resolution_clock::now();
+  auto duration_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+          .count();
+  std::cout << "bench " << name << " nodes " << count << " time "
+            << duration_ms << " milliseconds nps "
+            << count * 1000 / std::max<std::int64_t>(duration_ms, 1);
+  for (int event = 0; event < PerfCounters::NUM_EVENTS; ++event) {
+    auto e = static_cast<PerfCounters::Event>(event);
+    std::cout << " " << PerfCounters::EVENT_NAMES[event] << "/node ";
+    if (counters.Available(e)) {
+      std::cout << static_cast<double>(counters.Read(e)) /
+                       std::max<std::uint64_t>(count, 1);
+    } else {
+      std::cout << "n/a";
+    }
+  }
+  if (counters.Available(PerfCounters::CYCLES) &&
+      counters.Available(PerfCounters::INSTRUCTIONS)) {
+    std::cout << " ipc "
+              << static_cast<double>(counters.Read(PerfCounters::INSTRUCTIONS)) /
+                     std::max<std::uint64_t>(
+                         counters.Read(PerfCounters::CYCLES), 1);
+  }
+  std::cout << std::endl;
+}
+
+// Fixed-depth searches over BENCH_FENS and a perft, each measured with
+// hardware counters. The search results go to stdout/stderr as usual.
+void Benchmark(int depth) {
+  PerfCounters counters;
+  BenchPhase(counters, "perft", [] {
+    ply = 0;
+    positions[0] = SearchPosition(Board(constants::STARTPOS));
+    return PerftCopyMake(positions[0], 5);
+  });
+
+  std::memset(hash_table, 0, sizeof(hash_table));
+  std::memset(eval_cache, 0, sizeof(eval_cache));
+  BenchPhase(counters, "search", [&] {
+    std::uint64_t total_nodes = 0;
+    for (const char *fen : BENCH_FENS) {
+      board_repetition.clear();
+      std::string position = fen;
+      search(position, depth);
+      total_nodes += nodes;
+    }
+    return total_nodes;
+  });
+}
+
+// Limits of a search from scratch, 0 for no limit.
+struct SearchLimits {
+  int depth = 0;
+  int nodes = 0;
+  int time_ms = 0;
+};
+
+// Searches the board with cleared tables and no game history, as a newly
+// started engine would. With no limit at all, searches to MAX_SEARCH_DEPTH.
+SearchResult SearchFromScratch(
+    const Board &board, const SearchLimits &limits,
+    const std::function<void(const SearchResult &)> &on_iteration = {}) {
+  ResetGlobal();
+  ClearSearchTables();
+  board_repetition.clear();
+  if (limits.nodes > 0) node_limit = limits.nodes;
+
+  auto deadline =
+      limits.time_ms > 0
+          ? std::chrono::high_resolution_clock::now() +
+                std::chrono::milliseconds(limits.time_ms)
+          : std::chrono::time_point<std::chrono::high_resolution_clock>::max();
+  Seen(board.hash());
+  positions[0] = SearchPosition(board);
+  return IterativeDeepening(
+      limits.depth > 0 ? std::min(limits.depth, MAX_PLY - 1)
+                       : MAX_SEARCH_DEPTH,
+      deadline, on_iteration);
+}
+
+// An EPD operation, e.g. `bm Qd5 Nf3;`.
+struct EpdOperation {
+  std::string opcode;
+  std::vector<std::string> operands;
+};
+
+// Whether `field` (0 to 3: placement, side, castling, en passant) of a FEN
+// is well formed, which Board relies on.
+bool IsFenFieldValid(int field, const std::string &text) {
+  switch (field) {
+    case 0: {
+      int ranks = 1;
+      int squares = 0;
+      for (char c : text) {
+        if (c == '/') {
+          if (squares != 8) return false;
+          ranks++;
+          squares = 0;
+        } else if (c >= '1' && c <= '8') {
+          squares += c - '0';
+        } else if (std::string_view("pnbrqkPNBRQK").find(c) !=
+                   std::string_view::npos) {
+          squares++;
+        } else {
+          return false;
+        }
+        if (squares > 8) return false;
+      }
+      return ranks == 8 && squares == 8;
+    }
+    case 1:
+      return text == "w" || text == "b";
+    case 2:
+      return text == "-" || (text.size() <= 4 &&
+                             text.find_first_not_of("KQkq") == std::string::npos);
+    default:
+      return text == "-" || (text.size() == 2 && text[0] >= 'a' &&
+                             text[0] <= 'h' && (text[1] == '3' || text[1] == '6'));
+  }
+}
+
+// Splits an EPD line, or a FEN line optionally followed by EPD operations,
+// into the FEN and the operations. Returns false when the line has no
+// well-formed position.
+bool SplitEpd(const std::string &line, std::string &fen,
+              std::vector<EpdOperation> &operations) {
+  std::istringstream fields(line);
+  fen.clear();
+  operations.clear();
+  for (int i = 0; i < 4; ++i) {
+    std::string field;
+    if (!(fields >> field) || !IsFenFieldValid(i, field)) return false;
+    fen += field + " ";
+  }
+  // FEN move counters, EPD has none.
+  std::string rest;
+  std::getline(fields, rest);
+  std::istringstream counters(rest);
+  int half_moves;
+  int full_moves;
+  if (counters >> half_moves >> full_moves) {
+    fen += std::to_string(half_moves) + " " + std::to_string(full_moves);
+    // getline leaves rest untouched when the counters end the line.
+    rest.clear();
+    std::getline(counters, rest);
+  } else {
+    fen += "0 1";
+  }
+
+  std::istringstream operation_stream(rest);
+  std::string operation;
+  while (std::getline(operation_stream, operation, ';')) {
+    std::istringstream tokens(operation);
+    EpdOperation op;
+    if (!(tokens >> op.opcode)) continue;
+    std::string operand;
+    while (tokens >> operand) op.operands.push_back(operand);
+    operations.push_back(op);
+  }
+  return true;
+}
+
+// Whether the search can be run on the board: one king per side, the king
+// and rook of every castling right on their squares, no pawns on the first or
+// last rank, and the side not to move not in check. The search and move
+// generation assume all of these.
+bool IsSearchable(const Board &board) {
+  for (Color color : {Color::WHITE, Color::BLACK}) {
+    if (board.pieces(PieceType::KING, color).count() != 1) return false;
+    for (auto side :
+         {CastlingRights::Side::KING_SIDE, CastlingRights::Side::QUEEN_SIDE}) {
+      if (!board.castlingRights().has(color, side)) continue;
+      Square king_sq = Square(Square::underlying::SQ_E1).relative_square(color);
+      Square rook_sq =
+          Square(board.castlingRights().getRookFile(color, side), Rank::RANK_1)
+              .relative_square(color);
+      if (board.at(king_sq) != Piece(PieceType::KING, color) ||
+          board.at(rook_sq) != Piece(PieceType::ROOK, color)) {
+        return false;
+      }
+    }
+  }
+  if (board.pieces(PieceType::PAWN) &
+      (Bitboard(Rank::RANK_1) | Bitboard(Rank::RANK_8))) {
+    return false;
+  }
+  Color us = board.sideToMove();
+  return !board.isAttacked(board.kingSq(~us), us);
+}
+
+// Whether the line has nothing but whitespace.
+bool IsBlank(const std::string &line) {
+  return line.find_first_not_of(" \t\r") == std::string::npos;
+}
+
+// Test position from an EPD file, with the moves that solve it: one of the
+// best moves (bm), or any move but the ones to avoid (am).
+struct EpdPosition {
+  std::string id;
+  Board board;
+  std::vector<Move> best_moves;
+  std::vector<Move> avoid_moves;
+
+  bool Solves(Move move) const {
+    auto contains = [&](const std::vector<Move> &moves) {
+      return std::find(moves.begin(), moves.end(), move) != moves.end();
+    };
+    if (!best_moves.empty() && !contains(best_moves)) return false;
+    return !contains(avoid_moves);
+  }
+};
+
+// Parses `<four FEN fields> bm Qd5 Nf3; am e4; id "name";`. Returns false
+// when the line has no position, no bm or am, or a move that is not legal.
+bool ParseEpd(const std::string &line, EpdPosition &position) {
+  std::string fen;
+  std::vector<EpdOperation> operations;
+  if (!SplitEpd(line, fen, operations)) return false;
+  position.board = Board(fen);
+  if (!IsSearchable(position.board)) return false;
+  position.best_moves.clear();
+  position.avoid_moves.clear();
+
+  for (const auto &op : operations) {
+    if (op.opcode == "id") {
+      position.id.clear();
+      for (const auto &operand : op.operands) {
+        if (!position.id.empty()) position.id += " ";
+        position.id += operand;
+      }
+      position.id.erase(std::remove(position.id.begin(), position.id.end(), '"'),
+                        position.id.end());
+      continue;
+    }
+    if (op.opcode != "bm" && op.opcode != "am") continue;
+    auto &moves = op.opcode == "bm" ? position.best_moves : position.avoid_moves;
+    for (std::string operand : op.operands) {
+      // Drop annotations like "Qxf7!".
+      while (!operand.empty() &&
+             (operand.back() == '!' || operand.back() == '?')) {
+        operand.pop_back();
+      }
+      Move move;
+      if (uci::parseSanFast(position.board, operand, move) !=
+          uci::SanError::NONE) {
+        return false;
+      }
+      moves.push_back(move);
+    }
+  }
+  return !position.best_moves.empty() || !position.avoid_moves.empty();
+}
+
+// How a test position was searched. The time, nodes and depth to solution
+// are those at the end of the iteration from which on every iteration
+// returned a solving move.
+struct EpdResult {
+  bool solved = false;
+  Move move = Move::NO_MOVE;
+  int depth = 0;
+  std::int64_t time_ms = 0;
+  int nodes = 0;
+};
+
+EpdResult SolveEpd(const EpdPosition &position, const SearchLimits &limits) {
+  auto start = std::chrono::high_resolution_clock::now();
+  EpdResult solution;
+  SearchResult result = SearchFromScratch(
+      position.board, limits, [&](const SearchResult &iteration) {
+        if (!position.Solves(iteration.best_move)) {
+          solution.solved = false;
+        } else if (!solution.solved) {
+          solution.solved = true;
+          solution.depth = iteration.depth;
+          solution.time_ms =
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::high_resolution_clock::now() - start)
+                  .count();
+          solution.nodes = nodes;
+        }
+      });
+  solution.move = result.best_move;
+  return solution;
+}
+
+// Value below which `fraction` of the sorted values lie.
+template <typename T>
+T Percentile(const std::vector<T> &sorted, double fraction) {
+  if (sorted.empty()) return 0;
+  return sorted[std::min(sorted.size() - 1,
+                         static_cast<size_t>(fraction * sorted.size()))];
+}
+
+// Runs an EPD test suite. Positions are read as they are needed and
+// searched on `threads` threads, each with its own search state, so every
+// position is searched as if by a fresh engine. One line per position is
+// printed as it finishes, then the solved count and the distributions of
+// time and nodes to solution.
+void RunEpd(const std::string &path, int time_ms, int max_nodes, int threads) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cout << "cannot open " << path << std::endl;
+    return;
+  }
+  SearchLimits limits;
+  limits.nodes = max_nodes;
+  limits.time_ms = time_ms;
+  std::mutex mutex;
+  int next_index = 0;
+  int total = 0;
+  std::vector<std::int64_t> solve_times;
+  std::vector<int> solve_nodes;
+
+  auto worker = [&] {
+    for (;;) {
+      std::string line;
+      int index;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        do {
+          if (!std::getline(file, line)) return;
+        } while (IsBlank(line));
+        index = next_index++;
+      }
+      EpdPosition position;
+      if (!ParseEpd(line, position)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "epd " << index << " skipped: " << line << std::endl;
+        continue;
+      }
+      EpdResult result = SolveEpd(position, limits);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      total++;
+      std::cout << "epd " << index << " " << position.id << " "
+                << (result.solved ? "solved" : "failed") << " move "
+                << (result.move != Move::NO_MOVE
+                        ? uci::moveToSan(position.board, result.move)
+                        : "none");
+      if (result.solved) {
+        solve_times.push_back(result.time_ms);
+        solve_nodes.push_back(result.nodes);
+        std::cout << " depth " << result.depth << " time " << result.time_ms
+                  << " milliseconds nodes " << result.nodes;
+      }
+      std::cout << std::endl;
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+  for (auto &thread : pool) thread.join();
+
+  std::sort(solve_times.begin(), solve_times.end());
+  std::sort(solve_nodes.begin(), solve_nodes.end());
+  std::cout << "epd solved " << solve_times.size() << "/" << total
+            << " time_to_solution p50 " << Percentile(solve_times, 0.5)
+            << " p90 " << Percentile(solve_times, 0.9) << " max "
+            << Percentile(solve_times, 1.0) << " milliseconds"
+            << " nodes_to_solution p50 " << Percentile(solve_nodes, 0.5)
+            << " p90 " << Percentile(solve_nodes, 0.9) << " max "
+            << Percentile(solve_nodes, 1.0) << std::endl;
+}
+
+// Items per thread that the batch modes start ahead of the oldest result not
+// yet written. Bounds the positions or games held in memory at once.
+static constexpr int WORK_AHEAD_PER_THREAD = 4;
+
+// Writes results of work items numbered 0, 1, 2... in that order while the
+// items finish in any order, holding early results until their turn.
+class ReorderBuffer {
+ public:
+  ReorderBuffer(std::ostream &out, int window) : out_(out), window_(window) {}
+
+  // Blocks until item `index` is within the window after the oldest result
+  // not yet written.
+  void WaitForSlot(int index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slot_free_.wait(lock, [&] { return index < next_output_ + window_; });
+  }
+
+  void Write(int index, std::string text) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_[index] = std::move(text);
+    while (!pending_.empty() && pending_.begin()->first == next_output_) {
+      out_ << pending_.begin()->second << "\n";
+      pending_.erase(pending_.begin());
+      next_output_++;
+    }
+    out_.flush();
+    slot_free_.notify_all();
+  }
+
+  int Written() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_output_;
+  }
+
+ private:
+  std::ostream &out_;
+  const int window_;
+  std::mutex mutex_;
+  std::condition_variable slot_free_;
+  int next_output_ = 0;
+  std::map<int, std::string> pending_;
+};
+
+// Searches one FEN or EPD line and formats its result. `depth N;`,
+// `nodes N;` and `movetime N;` operations on the line override `limits`.
+std::string AnalyzeLine(const std::string &line, SearchLimits limits) {
+  std::string fen;
+  std::vector<EpdOperation> operations;
+  if (!SplitEpd(line, fen, operations)) return "error " + line;
+  Board board(fen);
+  if (!IsSearchable(board)) return "error " + line;
+  for (const auto &op : operations) {
+    if (op.operands.empty()) continue;
+    int value = std::atoi(op.operands[0].c_str());
+    if (op.opcode == "depth") limits.depth = value;
+    if (op.opcode == "nodes") limits.nodes = value;
+    if (op.opcode == "movetime") limits.time_ms = value;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  SearchResult result = SearchFromScratch(board, limits);
+  auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::high_resolution_clock::now() - start)
+                         .count();
+
+  std::ostringstream out;
+  out << fen << " bestmove "
+      << (result.best_move != Move::NO_MOVE ? uci::moveToUci(result.best_move)
+                                            : "none")
+      << " eval " << std::showpos << result.eval << std::noshowpos << " depth "
+      << result.depth << " nodes " << nodes << " time " << duration_ms
+      << " milliseconds pv";
+  for (int i = 0; i < root_pv_length; ++i) {
+    out << " " << uci::moveToUci(root_pv[i]);
+  }
+  return out.str();
+}
+
+// Analyzes the FEN or EPD lines of `input` on `threads` threads, each with
+// its own search state, and writes one line per input line in input order.
+// Blank lines are skipped, and positions that cannot be searched give an
+// "error <line>" line. The eval is from the side to move's point of view.
+void Analyze(std::istream &input, const SearchLimits &limits, int threads) {
+  ReorderBuffer output(std::cout, threads * WORK_AHEAD_PER_THREAD);
+  std::mutex input_mutex;
+  int next_input = 0;
+  std::atomic<std::uint64_t> total_nodes{0};
+  auto start = std::chrono::high_resolution_clock::now();
+
+  auto worker = [&] {
+    for (;;) {
+      std::string line;
+      int index;
+      {
+        std::lock_guard<std::mutex> lock(input_mutex);
+        do {
+          if (!std::getline(input, line)) return;
+        } while (IsBlank(line));
+        index = next_input++;
+      }
+      output.WaitForSlot(index);
+      output.Write(index, AnalyzeLine(line, limits));
+      total_nodes += nodes;
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+  for (auto &thread : pool) thread.join();
+
+  auto duration_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::high_resolution_clock::now() - start)
+          .count();
+  std::cerr << "analyze positions " << output.Written() << " threads "
+            << threads << " time " << duration_ms
+            << " milliseconds positions/s "
+            << output.Written() * 1000.0 / std::max<std::int64_t>(duration_ms, 1)
+            << " nps "
+            << total_nodes * 1000 / std::max<std::int64_t>(duration_ms, 1)
+            << std::endl;
+}
+
+// Evals are clamped to this when measuring what a move lost, so that a missed
+// mate counts like a large material loss.
+static constexpr int ANNOTATE_EVAL_CLAMP = 2000;
+// A move that loses the side that played it this much eval is a blunder.
+static constexpr int BLUNDER_MARGIN = 200;
+
+// A game as read from a PGN file.
+struct PgnGame {
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::vector<std::string> moves;
+};
+
+// Collects the games of a pgn::StreamParser, handing each one on when it
+// ends. Comments and variations of the input are dropped.
+class GameCollector : public pgn::Visitor {
+ public:
+  explicit GameCollector(std::function<void(PgnGame &&)> on_game)
+      : on_game_(std::move(on_game)) {}
+
+  void startPgn() override {
+    game_ = PgnGame();
+    in_game_ = true;
+  }
+
+  void header(std::string_view key, std::string_view value) override {
+    game_.headers.emplace_back(key, value);
+  }
+
+  void startMoves() override {}
+
+  // Comments are dropped, the annotated game gets new ones. An empty move
+  // is a comment in a game without moves.
+  void move(std::string_view move, std::string_view) override {
+    if (move.empty()) return;
+    game_.moves.emplace_back(move);
+  }
+
+  void endPgn() override {
+    if (!in_game_) return;
+    in_game_ = false;
+    on_game_(std::move(game_));
+  }
+
+ private:
+  std::function<void(PgnGame &&)> on_game_;
+  PgnGame game_;
+  bool in_game_ = false;
+};
+
+// Formats a side-relative eval from White's point of view, in pawns or as
+// "#N" / "#-N" for mate in N moves.
+std::string FormatWhiteEval(int eval, Color side_to_move) {
+  if (side_to_move == Color::BLACK) eval = -eval;
+  if (std::abs(eval) >= MATE_BOUND) {
+    int moves = (MATE - std::abs(eval) + 1) / 2;
+    return (eval > 0 ? "#" : "#-") + std::to_string(moves);
+  }
+  char text[16];
+  std::snprintf(text, sizeof(text), "%.2f", eval / 100.0);
+  return text;
+}
+
+std::string JsonString(const std::string &text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') quoted += '\\';
+    if (static_cast<unsigned char>(c) >= 0x20) quoted += c;
+  }
+  return quoted + "\"";
+}
+
+// Replays the game and searches every position with a node limit. Returns
+// the game as PGN, with the eval after each move in a [%eval] comment and
+// blunders marked $4 with the best move, or as a single line of JSON.
+std::string AnnotateGame(const PgnGame &game, int max_nodes, bool json) {
+  std::string fen = constants::STARTPOS;
+  std::string result = "*";
+  for (const auto &[key, value] : game.headers) {
+    if (key == "FEN") fen = value;
+    if (key == "Result") result = value;
+  }
+  SearchLimits limits;
+  limits.nodes = max_nodes;
+
+  // Played move, and the eval and best move of the position before it.
+  struct Ply {
+    Move move;
+    std::string san;
+    Color side;
+    int move_number;
+    int eval_before;
+    Move best_move;
+    std::string best_san;
+  };
+  std::vector<Ply> plies;
+  std::string error;
+  // The FEN header comes from the file, check it like an EPD line before the
+  // board is set up from it. A bad one leaves the game without moves.
+  std::string normalized_fen;
+  std::vector<EpdOperation> operations;
+  bool fen_valid =
+      SplitEpd(fen, normalized_fen, operations) && operations.empty();
+  Board board(fen_valid ? normalized_fen : std::string(constants::STARTPOS));
+  if (!fen_valid || !IsSearchable(board)) error = "invalid FEN " + fen;
+  for (const auto &san : game.moves) {
+    if (!error.empty()) break;
+    SearchResult searched = SearchFromScratch(board, limits);
+    Ply ply = {Move::NO_MOVE, san, board.sideToMove(),
+               static_cast<int>(board.fullMoveNumber()), searched.eval,
+               searched.best_move, ""};
+    if (uci::parseSanFast(board, san, ply.move) != uci::SanError::NONE) {
+      error = "illegal move " + san;
+      break;
+    }
+    if (ply.best_move != Move::NO_MOVE) {
+      ply.best_san = uci::moveToSan(board, ply.best_move);
+    }
+    ply.san = uci::moveToSan(board, ply.move);
+    plies.push_back(ply);
+    board.makeMove(ply.move);
+  }
+  int final_eval = error.empty() ? SearchFromScratch(board, limits).eval : 0;
+  // A mate has no eval to show after it.
+  bool mated = false;
+  if (error.empty() && board.inCheck()) {
+    Movelist moves;
+    movegen::legalmoves(moves, board);
+    mated = moves.empty();
+  }
+
+  std::ostringstream out;
+  std::string movetext;
+  if (json) {
+    out << "{\"headers\":{";
+    for (size_t i = 0; i < game.headers.size(); ++i) {
+      out << (i ? "," : "") << JsonString(game.headers[i].first) << ":"
+          << JsonString(game.headers[i].second);
+    }
+    out << "},\"moves\":[";
+  } else {
+    for (const auto &[key, value] : game.headers) {
+      std::string escaped;
+      for (char c : value) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+      }
+      out << "[" << key << " \"" << escaped << "\"]\n";
+    }
+    out << "\n";
+  }
+  // PGN movetext lines are wrapped before 80 characters.
+  size_t line_length = 0;
+  auto add_token = [&](const std::string &token) {
+    if (line_length > 0 && line_length + 1 + token.size() >= 80) {
+      out << "\n";
+      line_length = 0;
+    } else if (line_length > 0) {
+      out << " ";
+      line_length++;
+    }
+    out << token;
+    line_length += token.size();
+  };
+
+  for (size_t i = 0; i < plies.size(); ++i) {
+    const Ply &ply = plies[i];
+    // Both evals side-relative: before the move for the mover, after the
+    // move for the opponent.
+    int eval_after = i + 1 < plies.size() ? plies[i + 1].eval_before
+                                          : final_eval;
+    bool scored = i + 1 < plies.size() || (error.empty() && !mated);
+    int loss = std::clamp(ply.eval_before, -ANNOTATE_EVAL_CLAMP,
+                          ANNOTATE_EVAL_CLAMP) +
+               std::clamp(eval_after, -ANNOTATE_EVAL_CLAMP,
+                          ANNOTATE_EVAL_CLAMP);
+    bool blunder = scored && loss >= BLUNDER_MARGIN;
+    std::string eval = FormatWhiteEval(eval_after, ~ply.side);
+
+    if (json) {
+      out << (i ? "," : "") << "{\"san\":" << JsonString(ply.san)
+          << ",\"eval\":" << (scored ? JsonString(eval) : "null")
+          << ",\"best\":" << JsonString(ply.best_san)
+          << ",\"loss\":" << (scored ? loss : 0)
+          << ",\"blunder\":" << (blunder ? "true" : "false") << "}";
+      continue;
+    }
+    if (ply.side == Color::WHITE) {
+      add_token(std::to_string(ply.move_number) + ".");
+    } else if (i == 0) {
+      add_token(std::to_string(ply.move_number) + "...");
+    }
+    add_token(ply.san);
+    if (blunder) add_token("$4");
+    if (scored) {
+      add_token("{ [%eval " + eval + "]" +
+                (blunder ? " blunder, best " + ply.best_san : "") + " }");
+    }
+    // The next white move needs no number, a black move after a comment
+    // gets one.
+    if (ply.side == Color::WHITE && i + 1 < plies.size()) {
+      add_token(std::to_string(ply.move_number) + "...");
+    }
+  }
+
+  if (json) {
+    out << "],\"result\":" << JsonString(result);
+    if (!error.empty()) out << ",\"error\":" << JsonString(error);
+    out << "}";
+  } else {
+    if (!error.empty()) add_token("{ " + error + " }");
+    add_token(result);
+    out << "\n";
+  }
+  return out.str();
+}
+
+// Annotates the games of a PGN stream on `threads` threads, each with its
+// own search state, and writes them in input order. The parser waits while
+// `threads * WORK_AHEAD_PER_THREAD` games are in flight, so memory does not
+// grow with the size of the input.
+void Annotate(std::istream &input, int max_nodes, int threads, bool json) {
+  ReorderBuffer output(std::cout, threads * WORK_AHEAD_PER_THREAD);
+  std::mutex mutex;
+  std::condition_variable queue_ready;
+  std::deque<std::pair<int, PgnGame>> queue;
+  bool input_done = false;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  auto worker = [&] {
+    for (;;) {
+      std::pair<int, PgnGame> item;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue_ready.wait(lock, [&] { return input_done || !queue.empty(); });
+        if (queue.empty()) return;
+        item = std::move(queue.front());
+        queue.pop_front();
+      }
+      output.Write(item.first, AnnotateGame(item.second, max_nodes, json));
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+
+  int games = 0;
+  GameCollector collector([&](PgnGame &&game) {
+    int index = games++;
+    output.WaitForSlot(index);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.emplace_back(index, std::move(game));
+    }
+    queue_ready.notify_one();
+  });
+  try {
+    pgn::StreamParser parser(input);
+    parser.readGames(collector);
+  } catch (const pgn::StreamParserException &e) {
+    std::cerr << "pgn error " << e.what() << std::endl;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    input_done = true;
+  }
+  queue_ready.notify_all();
+  for (auto &thread : pool) thread.join();
+
+  auto duration_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::high_resolution_clock::now() - start)
+          .count();
+  std::cerr << "annotate games " << games << " threads " << threads
+            << " time " << duration_ms << " milliseconds" << std::endl;
+}
+
+// Counts what a PGN parser hands out, touching every byte of it.
+class PgnCounter : public pgn::Visitor {
+ public:
+  void startPgn() override {}
+  void header(std::string_view key, std::string_view value) override {
+    headers++;
+    bytes += key.size() + value.size();
+  }
+  void startMoves() override {}
+  void move(std::string_view move, std::string_view comment) override {
+    if (!move.empty()) moves++;
+    for (char c : move) checksum = checksum * 31 + c;
+    bytes += move.size() + comment.size();
+  }
+  void endPgn() override { games++; }
+
+  std::uint64_t games = 0;
+  std::uint64_t headers = 0;
+  std::uint64_t moves = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t checksum = 0;
+};
+
+// Replays the games, decoding each move with uci::parseSanFast, or with
+// uci::parseSan when not `fast`. The checksum is over the positions reached,
+// so both decoders give the same one. A game is dropped at its first move
+// that does not decode.
+class PgnReplayer : public PgnCounter {
+ public:
+  explicit PgnReplayer(bool fast) : fast_(fast) {}
+
+  void startPgn() override { board_.setFen(constants::STARTPOS); }
+  void header(std::string_view key, std::string_view value) override {
+    if (key == "FEN") board_.setFen(value);
+  }
+  void move(std::string_view move, std::string_view) override {
+    if (move.empty()) return;
+    Move decoded = Move::NO_MOVE;
+    if (fast_) {
+      if (uci::parseSanFast(board_, move, decoded) != uci::SanError::NONE) {
+        decoded = Move::NO_MOVE;
+      }
+    } else {
+      try {
+        decoded = uci::parseSan(board_, move);
+      } catch (const uci::SanParseError &) {
+      }
+    }
+    if (decoded == Move::NO_MOVE) {
+      errors++;
+      skipPgn(true);
+      return;
+    }
+    board_.makeMove(decoded);
+    moves++;
+    checksum = checksum * 31 + board_.hash();
+  }
+
+  std::uint64_t errors = 0;
+
+ private:
+  bool fast_;
+  Board board_;
+};
+
+// Parses a PGN file with pgn::StreamParser, then from a memory mapping on
+// one thread and on `threads` threads over disjoint ranges, and reports
+// the throughput of each. Then replays the games from the mapping with
+// each SAN decoder.
+void PgnBenchmark(const std::string &path, int threads) {
+  std::uint64_t size = 0;
+  {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    size = file ? static_cast<std::uint64_t>(file.tellg()) : 0;
+  }
+  auto run = [&](const char *name, auto parse) {
+    auto start = std::chrono::high_resolution_clock::now();
+    PgnCounter counter = parse();
+    auto end = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "pgnbench " << name << " games " << counter.games
+              << " moves " << counter.moves << " checksum " << counter.checksum
+              << " time " << static_cast<int>(seconds * 1000)
+              << " milliseconds mb/s " << size / 1e6 / std::max(seconds, 1e-9)
+              << std::endl;
+  };
+
+  run("stream", [&] {
+    PgnCounter counter;
+    std::ifstream file(path, std::ios::binary);
+    pgn::StreamParser parser(file);
+    parser.readGames(counter);
+    return counter;
+  });
+
+  MappedPgn mapped(path.c_str());
+  if (!mapped.Ok()) {
+    std::cout << "cannot map " << path << std::endl;
+    return;
+  }
+  run("mapped", [&] {
+    PgnCounter counter;
+    ParsePgn(mapped.Text(), counter);
+    return counter;
+  });
+  run("mapped_parallel", [&] {
+    std::vector<std::string_view> ranges = mapped.Split(threads);
+    std::vector<PgnCounter> counters(ranges.size());
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      pool.emplace_back([&, i] { ParsePgn(ranges[i], counters[i]); });
+    }
+    for (auto &thread : pool) thread.join();
+    // The checksum only matches the others on one thread.
+    PgnCounter total;
+    for (const auto &counter : counters) {
+      total.games += counter.games;
+      total.moves += counter.moves;
+      total.checksum ^= counter.checksum;
+    }
+    return total;
+  });
+  for (bool fast : {false, true}) {
+    std::uint64_t errors = 0;
+    run(fast ? "replay_parse_san_fast" : "replay_parse_san", [&] {
+      PgnReplayer replayer(fast);
+      ParsePgn(mapped.Text(), replayer);
+      errors = replayer.errors;
+      return static_cast<PgnCounter>(replayer);
+    });
+    if (errors > 0) {
+      std::cout << "pgnbench games with undecodable moves " << errors
+                << std::endl;
+    }
+  }
 }
 
 constexpr bool debug = false;
 int main(int argc, char **argv) {
+  // perft [depth] [fen]
+  if (argc >= 2 && std::string(argv[1]) == "perft") {
+    int depth = argc >= 3 ? std::stoi(argv[2]) : 5;
+    std::string fen = argc >= 4 ? argv[3] : constants::STARTPOS;
+    PerftBenchmark(fen, depth);
+    return 0;
+  }
+  // bench [depth]
+  if (argc >= 2 && std::string(argv[1]) == "bench") {
+    Benchmark(argc >= 3 ? std::stoi(argv[2]) : 9);
+    return 0;
+  }
+  // analyze [file|-] [time_ms] [depth] [nodes] [threads]
+  if (argc >= 2 && std::string(argv[1]) == "analyze") {
+    SearchLimits limits;
+    limits.time_ms = argc >= 4 ? std::stoi(argv[3]) : 1000;
+    limits.depth = argc >= 5 ? std::stoi(argv[4]) : 0;
+    limits.nodes = argc >= 6 ? std::stoi(argv[5]) : 0;
+    int threads = argc >= 7 ? std::stoi(argv[6]) : MAX_SEARCH_THREADS;
+    std::string path = argc >= 3 ? argv[2] : "-";
+    std::ifstream file;
+    if (path != "-") file.open(path);
+    Analyze(path != "-" ? file : std::cin, limits, SearchThreads(threads));
+    return 0;
+  }
+  // annotate <file|-> [nodes] [threads] [pgn|json]
+  if (argc >= 3 && std::string(argv[1]) == "annotate") {
+    int max_nodes = argc >= 4 ? std::stoi(argv[3]) : 100000;
+    int threads = argc >= 5 ? std::stoi(argv[4]) : MAX_SEARCH_THREADS;
+    bool json = argc >= 6 && std::string(argv[5]) == "json";
+    std::string path = argv[2];
+    std::ifstream file;
+    if (path != "-") file.open(path);
+    Annotate(path != "-" ? file : std::cin, max_nodes, SearchThreads(threads),
+             json);
+    return 0;
+  }
+  // pgnbench <file> [threads]
+  if (argc >= 3 && std::string(argv[1]) == "pgnbench") {
+    PgnBenchmark(argv[2],
+                 argc >= 4 ? std::stoi(argv[3])
+                           : std::max(1u, std::thread::hardware_concurrency()));
+    return 0;
+  }
+  // epd <file> [time_ms] [threads] [nodes]
+  if (argc >= 3 && std::string(argv[1]) == "epd") {
+    RunEpd(argv[2], argc >= 4 ? std::stoi(argv[3]) : 1000,
+           argc >= 6 ? std::stoi(argv[5]) : 0,
+           SearchThreads(argc >= 5 ? std::stoi(argv[4]) : MAX_SEARCH_THREADS));
+    return 0;
+  }
+
   if constexpr (debug) {
     std::cout << "debug mode" << std::endl;
     std::string fen = "8/p1P5/8/8/8/8/PPp5/KR6 w - - 0 1";
     Board board(fen);
     std::cout << board << std::endl;
-    std::cout << Evaluate(board) << std::endl;
+    std::cout << Evaluate(SearchPosition(board)) << std::endl;
     return 0;
   }
 
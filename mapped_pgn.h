@@ -0,0 +1,308 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "./chess.h"
+
+using namespace chess;
+
+// PGN reading straight from a memory-mapped file, for bulk ingestion where
+// pgn::StreamParser's copying into small buffers is the bottleneck. The
+// visitor gets string_views into the mapping, valid while the MappedPgn
+// lives. Header values are passed as written, escapes included.
+
+// A file mapped read-only into memory. Ok() is false if it could not be
+// mapped (missing file, or a system without mmap).
+class MappedPgn {
+ public:
+  explicit MappedPgn(const char *path) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      size_ = static_cast<std::size_t>(st.st_size);
+      if (size_ == 0) {
+        ok_ = true;
+      } else {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        // Reading the file in up front is cheaper than a fault per page.
+        flags |= MAP_POPULATE;
+#endif
+        void *data = mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+        if (data != MAP_FAILED) {
+          madvise(data, size_, MADV_SEQUENTIAL);
+          data_ = static_cast<const char *>(data);
+          ok_ = true;
+        }
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedPgn() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (data_ != nullptr) munmap(const_cast<char *>(data_), size_);
+#endif
+  }
+
+  MappedPgn(const MappedPgn &) = delete;
+  MappedPgn &operator=(const MappedPgn &) = delete;
+
+  bool Ok() const { return ok_; }
+
+  std::string_view Text() const {
+    return data_ != nullptr ? std::string_view(data_, size_)
+                            : std::string_view();
+  }
+
+  // Splits the text into at most `parts` consecutive ranges of about equal
+  // size, each starting at the first tag of a game, so they can be parsed
+  // independently.
+  std::vector<std::string_view> Split(int parts) const {
+    std::string_view text = Text();
+    std::vector<std::string_view> ranges;
+    std::size_t begin = 0;
+    for (int part = 1; part < parts && begin < text.size(); ++part) {
+      std::size_t end = GameStartFrom(text, text.size() / parts * part);
+      if (end <= begin) continue;
+      ranges.push_back(text.substr(begin, end - begin));
+      begin = end;
+    }
+    if (begin < text.size()) ranges.push_back(text.substr(begin));
+    return ranges;
+  }
+
+ private:
+  // Offset of the first game starting at or after `from`: a line starting
+  // with '[' whose previous non-blank line does not, i.e. not a tag of the
+  // game before. text.size() if there is none.
+  static std::size_t GameStartFrom(std::string_view text, std::size_t from) {
+    for (std::size_t pos = text.find("\n[", from == 0 ? 0 : from - 1);
+         pos != std::string_view::npos; pos = text.find("\n[", pos + 1)) {
+      // Skip back over blank lines to the end of the previous line.
+      std::size_t end = pos;
+      while (end > 0 && (text[end - 1] == '\n' || text[end - 1] == '\r' ||
+                         text[end - 1] == ' ' || text[end - 1] == '\t')) {
+        --end;
+      }
+      if (end == 0) return pos + 1;
+      std::size_t line_start = text.rfind('\n', end - 1);
+      line_start = line_start == std::string_view::npos ? 0 : line_start + 1;
+      if (text[line_start] != '[') return pos + 1;
+    }
+    return text.size();
+  }
+
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+  bool ok_ = false;
+};
+
+inline bool IsPgnSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Characters that end a movetext token, looked up by byte.
+inline constexpr auto PGN_TOKEN_END = [] {
+  std::array<bool, 256> table = {};
+  for (char c : {' ', '\t', '\n', '\r', '{', '(', ';'}) {
+    table[static_cast<unsigned char>(c)] = true;
+  }
+  return table;
+}();
+
+// Parses the games in `text` with the same visitor calls as
+// pgn::StreamParser::readGames(): startPgn, header per tag, startMoves, move
+// per move with the comment that follows it, and endPgn. A comment before the
+// first move is passed as move("", comment) only in a game without moves.
+// Several comments in a row are joined into one. Variations, NAGs, ";"
+// comments and "%" lines are skipped.
+inline void ParsePgn(std::string_view text, pgn::Visitor &visitor) {
+  const std::size_t n = text.size();
+  std::size_t i = 0;
+  bool in_game = false;
+  bool in_moves = false;
+  // The last move is reported once the comment after it is known.
+  bool has_move = false;
+  std::string_view move;
+  std::string_view comment;
+  // The first comment before the moves, and whether the game has moves.
+  bool has_lead_comment = false;
+  std::string_view lead_comment;
+  bool game_has_moves = false;
+  // Several comments in a row are joined here, a single one is not copied.
+  std::string joined_comment;
+  std::string joined_lead_comment;
+
+  auto join = [](std::string_view &to, std::string &joined,
+                 std::string_view body) {
+    if (to.empty()) {
+      to = body;
+      return;
+    }
+    if (to.data() != joined.data()) joined.assign(to.data(), to.size());
+    joined.append(body.data(), body.size());
+    to = joined;
+  };
+
+  auto report_move = [&] {
+    if (has_move && !visitor.skip()) visitor.move(move, comment);
+    has_move = false;
+    comment = {};
+  };
+  auto start_game = [&] {
+    if (in_game) return;
+    visitor.startPgn();
+    in_game = true;
+  };
+  auto end_game = [&] {
+    report_move();
+    if (in_game) {
+      if (!game_has_moves && has_lead_comment && !visitor.skip()) {
+        visitor.move("", lead_comment);
+      }
+      visitor.endPgn();
+      visitor.skipPgn(false);
+    }
+    in_game = false;
+    in_moves = false;
+    has_lead_comment = false;
+    lead_comment = {};
+    game_has_moves = false;
+  };
+  auto skip_line = [&] {
+    std::size_t end = text.find('\n', i);
+    i = end == std::string_view::npos ? n : end + 1;
+  };
+
+  while (i < n) {
+    char c = text[i];
+    if (IsPgnSpace(c)) {
+      ++i;
+      continue;
+    }
+    bool line_start = i == 0 || text[i - 1] == '\n';
+    if (c == '%' && line_start) {
+      skip_line();
+      continue;
+    }
+
+    // Tag pair. One after the moves starts the next game.
+    if (c == '[') {
+      if (in_moves) end_game();
+      start_game();
+      std::size_t key_end = i + 1;
+      while (key_end < n && !IsPgnSpace(text[key_end]) &&
+             text[key_end] != '"' && text[key_end] != ']') {
+        ++key_end;
+      }
+      std::string_view key = text.substr(i + 1, key_end - i - 1);
+      std::size_t line_end = text.find('\n', i);
+      if (line_end == std::string_view::npos) line_end = n;
+      // The value may hold a ']', the tag ends at the first one after it.
+      std::size_t tag_end = std::min(text.find(']', key_end), line_end);
+      std::size_t value_start = text.find('"', key_end);
+      std::string_view value;
+      if (value_start < tag_end) {
+        std::size_t value_end = value_start + 1;
+        while (value_end < line_end && text[value_end] != '"') {
+          value_end += text[value_end] == '\\' ? 2 : 1;
+        }
+        value_end = std::min(value_end, line_end);
+        value = text.substr(value_start + 1, value_end - value_start - 1);
+        tag_end = std::min(text.find(']', value_end), line_end);
+      }
+      if (!visitor.skip()) visitor.header(key, value);
+      // More tags may follow on the same line.
+      i = tag_end < line_end ? tag_end + 1 : line_end;
+      continue;
+    }
+
+    start_game();
+    if (!in_moves) {
+      in_moves = true;
+      if (!visitor.skip()) visitor.startMoves();
+    }
+
+    if (c == '{') {
+      std::size_t end = text.find('}', i + 1);
+      if (end == std::string_view::npos) end = n;
+      std::string_view body = text.substr(i + 1, end - i - 1);
+      if (!has_move) {
+        // A comment before the first move.
+        join(lead_comment, joined_lead_comment, body);
+        has_lead_comment = true;
+      } else {
+        join(comment, joined_comment, body);
+      }
+      i = end + 1;
+      continue;
+    }
+    if (c == ';') {
+      skip_line();
+      continue;
+    }
+    if (c == '(') {
+      // Variations nest, and may hold comments with parentheses.
+      int depth = 0;
+      for (; i < n; ++i) {
+        if (text[i] == '{') {
+          i = text.find('}', i);
+          if (i == std::string_view::npos) i = n - 1;
+        } else if (text[i] == '(') {
+          ++depth;
+        } else if (text[i] == ')' && --depth == 0) {
+          break;
+        }
+      }
+      ++i;
+      continue;
+    }
+
+    std::size_t end = i;
+    while (end < n &&
+           !PGN_TOKEN_END[static_cast<unsigned char>(text[end])]) {
+      ++end;
+    }
+    std::string_view token = text.substr(i, end - i);
+    i = end;
+    if (token[0] == '$' || token == ")") continue;
+    if (token == "1-0" || token == "0-1" || token == "1/2-1/2" ||
+        token == "*") {
+      end_game();
+      continue;
+    }
+    // Move numbers, "12." or "12...", possibly glued to the move.
+    std::size_t digits = 0;
+    while (digits < token.size() && token[digits] >= '0' &&
+           token[digits] <= '9') {
+      ++digits;
+    }
+    if (digits == token.size()) continue;
+    if (digits > 0 && token[digits] == '.') {
+      while (digits < token.size() && token[digits] == '.') ++digits;
+      token.remove_prefix(digits);
+      if (token.empty()) continue;
+    }
+    report_move();
+    move = token;
+    has_move = true;
+    game_has_moves = true;
+  }
+  end_game();
+}
@@ -0,0 +1,543 @@
+// Self-play match runner with a sequential probability ratio test.
+//
+//   g++ -std=c++17 -O2 -pthread match.cc -o match
+//   ./match [options] <engine1> <engine2>
+//
+// Plays engine1 against engine2 from paired openings: every opening is
+// played twice with colors swapped, and the pair's score is one sample of a
+// pentanomial SPRT on the logistic Elo of engine1 over engine2. The match
+// stops when the test accepts H0 (elo <= elo0) or H1 (elo >= elo1), or when
+// all pairs are played.
+//
+// Engines are shell commands, started once per game. By default they speak
+// the bot's own protocol: a FEN line and a line with the remaining overage
+// time in seconds, answered by a UCI move. With --uci1/--uci2 they speak UCI.
+//
+// Options:
+//   --pairs N          game pairs to play at most (default 1000)
+//   --concurrency N    games played at once (default: hardware threads)
+//   --tc BANK+INC      seconds of overage time and per move time (10+0.1)
+//   --openings FILE    opening FENs or EPDs, one per line
+//   --random-plies N   without --openings, random plies from the start (8)
+//   --max-plies N      plies after which the game is drawn (400)
+//   --elo0 E --elo1 E  SPRT hypotheses (0 and 5)
+//   --alpha A --beta B SPRT error rates (0.05 each)
+//   --seed S           seed of the random openings (1)
+//
+// Exit status: 0 when H1 is accepted, 1 when H0 is accepted, 2 when the
+// test is inconclusive.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./chess.h"
+
+using namespace chess;
+
+extern char **environ;
+
+using Clock = std::chrono::steady_clock;
+
+struct EngineConfig {
+  std::string command;
+  bool uci = false;
+};
+
+struct Options {
+  EngineConfig engines[2];
+  int pairs = 1000;
+  int concurrency = std::max(1u, std::thread::hardware_concurrency());
+  double bank_s = 10;
+  double increment_s = 0.1;
+  std::string openings_file;
+  int random_plies = 8;
+  int max_plies = 400;
+  double elo0 = 0;
+  double elo1 = 5;
+  double alpha = 0.05;
+  double beta = 0.05;
+  unsigned seed = 1;
+};
+
+// An engine subprocess with its stdin and stdout on pipes. stderr goes to
+// /dev/null, the bot logs every search there. The process is killed when the
+// object is destroyed.
+class Engine {
+ public:
+  explicit Engine(const std::string &command) {
+    int to_child[2];
+    int from_child[2];
+    // Close-on-exec, so engines started by other threads at the same time
+    // do not inherit these pipes and keep them open.
+    if (pipe2(to_child, O_CLOEXEC) != 0) return;
+    if (pipe2(from_child, O_CLOEXEC) != 0) {
+      close(to_child[0]);
+      close(to_child[1]);
+      return;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to_child[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, from_child[1], 1);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    // exec, so that pid_ is the engine and not the shell.
+    std::string shell_command = "exec " + command;
+    const char *argv[] = {"sh", "-c", shell_command.c_str(), nullptr};
+    if (posix_spawn(&pid_, "/bin/sh", &actions, nullptr,
+                    const_cast<char **>(argv), environ) != 0) {
+      pid_ = -1;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(to_child[0]);
+    close(from_child[1]);
+    in_ = to_child[1];
+    out_ = from_child[0];
+  }
+
+  ~Engine() {
+    if (in_ >= 0) close(in_);
+    if (out_ >= 0) close(out_);
+    if (pid_ > 0) {
+      kill(pid_, SIGKILL);
+      waitpid(pid_, nullptr, 0);
+    }
+  }
+
+  Engine(const Engine &) = delete;
+  Engine &operator=(const Engine &) = delete;
+
+  bool Running() const { return pid_ > 0; }
+
+  bool Send(const std::string &line) {
+    std::string data = line + "\n";
+    size_t written = 0;
+    while (written < data.size()) {
+      ssize_t n = write(in_, data.data() + written, data.size() - written);
+      if (n <= 0) return false;
+      written += n;
+    }
+    return true;
+  }
+
+  // Reads the next line into `line`. Returns false on end of file, or when
+  // no full line arrived before the deadline.
+  bool ReadLine(std::string &line, Clock::time_point deadline) {
+    for (;;) {
+      size_t end = buffer_.find('\n');
+      if (end != std::string::npos) {
+        line = buffer_.substr(0, end);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        buffer_.erase(0, end + 1);
+        return true;
+      }
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - Clock::now());
+      if (remaining.count() <= 0) return false;
+      pollfd fd = {out_, POLLIN, 0};
+      if (poll(&fd, 1, static_cast<int>(remaining.count()) + 1) <= 0) continue;
+      char chunk[4096];
+      ssize_t n = read(out_, chunk, sizeof(chunk));
+      if (n <= 0) return false;
+      buffer_.append(chunk, n);
+    }
+  }
+
+ private:
+  pid_t pid_ = -1;
+  int in_ = -1;
+  int out_ = -1;
+  std::string buffer_;
+};
+
+// Remaining overage time of one side. A move may take the increment plus
+// the bank; whatever it takes beyond the increment is taken from the bank.
+struct GameClock {
+  double bank_s;
+  double increment_s;
+};
+
+// One side of a game.
+struct Player {
+  const EngineConfig *config;
+  Engine engine;
+  GameClock clock;
+
+  Player(const EngineConfig &engine_config, const Options &options)
+      : config(&engine_config),
+        engine(engine_config.command),
+        clock{options.bank_s, options.increment_s} {}
+};
+
+// Starts a UCI engine's game. Returns false if it does not answer in time.
+bool StartUci(Engine &engine) {
+  auto deadline = Clock::now() + std::chrono::seconds(10);
+  std::string line;
+  if (!engine.Send("uci")) return false;
+  do {
+    if (!engine.ReadLine(line, deadline)) return false;
+  } while (line != "uciok");
+  if (!engine.Send("ucinewgame") || !engine.Send("isready")) return false;
+  do {
+    if (!engine.ReadLine(line, deadline)) return false;
+  } while (line != "readyok");
+  return true;
+}
+
+// Asks the side to move for its move and charges its clock. Returns the
+// move in UCI notation, or an empty string if the engine lost on time or
+// died.
+std::string RequestMove(Player &player, const Player &opponent,
+                        const Board &board, const std::string &opening_fen,
+                        const std::vector<std::string> &moves) {
+  Engine &engine = player.engine;
+  GameClock &clock = player.clock;
+  std::string line;
+  auto start = Clock::now();
+  if (player.config->uci) {
+    std::string position = "position fen " + opening_fen;
+    if (!moves.empty()) position += " moves";
+    for (const auto &move : moves) position += " " + move;
+    bool white = board.sideToMove() == Color::WHITE;
+    auto ms = [](double s) { return std::to_string(std::lround(s * 1000)); };
+    const GameClock &white_clock = white ? clock : opponent.clock;
+    const GameClock &black_clock = white ? opponent.clock : clock;
+    if (!engine.Send(position)) return "";
+    start = Clock::now();
+    if (!engine.Send("go wtime " + ms(white_clock.bank_s) + " btime " +
+                     ms(black_clock.bank_s) + " winc " +
+                     ms(white_clock.increment_s) + " binc " +
+                     ms(black_clock.increment_s))) {
+      return "";
+    }
+  } else {
+    char bank[32];
+    std::snprintf(bank, sizeof(bank), "%.3f", clock.bank_s);
+    if (!engine.Send(board.getFen() + "\n" + bank)) return "";
+  }
+
+  auto deadline =
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(clock.bank_s +
+                                                clock.increment_s));
+  std::string move;
+  for (;;) {
+    if (!engine.ReadLine(line, deadline)) return "";
+    if (!player.config->uci) {
+      move = line;
+      break;
+    }
+    if (line.rfind("bestmove ", 0) == 0) {
+      std::istringstream tokens(line.substr(9));
+      tokens >> move;
+      break;
+    }
+  }
+  double elapsed_s =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  clock.bank_s -= std::max(0.0, elapsed_s - clock.increment_s);
+  if (clock.bank_s < 0) return "";
+  return move;
+}
+
+// Score of the white engine (1, 0.5 or 0) and why the game ended.
+struct GameOutcome {
+  double white_score;
+  std::string reason;
+};
+
+GameOutcome PlayGame(const EngineConfig &white, const EngineConfig &black,
+                     const std::string &opening_fen, const Options &options) {
+  Player players[2] = {Player(white, options), Player(black, options)};
+  for (int side = 0; side < 2; ++side) {
+    Player &player = players[side];
+    if (!player.engine.Running() ||
+        (player.config->uci && !StartUci(player.engine))) {
+      return {side == 0 ? 0.0 : 1.0, "engine failed to start"};
+    }
+  }
+
+  Board board(opening_fen);
+  std::vector<std::string> moves;
+  for (int plies = 0;; ++plies) {
+    auto [reason, result] = board.isGameOver();
+    bool white_to_move = board.sideToMove() == Color::WHITE;
+    if (result == GameResult::LOSE) {
+      return {white_to_move ? 0.0 : 1.0, "checkmate"};
+    }
+    if (result == GameResult::DRAW) {
+      switch (reason) {
+        case GameResultReason::STALEMATE:
+          return {0.5, "stalemate"};
+        case GameResultReason::INSUFFICIENT_MATERIAL:
+          return {0.5, "insufficient material"};
+        case GameResultReason::FIFTY_MOVE_RULE:
+          return {0.5, "fifty move rule"};
+        default:
+          return {0.5, "threefold repetition"};
+      }
+    }
+    if (plies >= options.max_plies) return {0.5, "max plies"};
+
+    Player &player = players[white_to_move ? 0 : 1];
+    Player &opponent = players[white_to_move ? 1 : 0];
+    double loss = white_to_move ? 0.0 : 1.0;
+    std::string uci = RequestMove(player, opponent, board, opening_fen, moves);
+    if (uci.empty()) return {loss, "time forfeit or crash"};
+
+    Move move = uci::uciToMove(board, uci);
+    Movelist legal;
+    movegen::legalmoves(legal, board);
+    if (std::find(legal.begin(), legal.end(), move) == legal.end()) {
+      return {loss, "illegal move " + uci};
+    }
+    board.makeMove(move);
+    moves.push_back(uci);
+  }
+}
+
+// Opening FENs from a file of FENs or EPDs. EPD operations after the four
+// position fields are dropped.
+std::vector<std::string> ReadOpenings(const std::string &path) {
+  std::vector<std::string> openings;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream tokens(line);
+    std::string fields[6];
+    int count = 0;
+    while (count < 6 && tokens >> fields[count]) ++count;
+    if (count < 4) continue;
+    std::string fen =
+        fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3];
+    bool counters = count == 6 && std::isdigit(fields[4][0]) &&
+                    std::isdigit(fields[5][0]);
+    openings.push_back(fen + (counters ? " " + fields[4] + " " + fields[5]
+                                       : " 0 1"));
+  }
+  return openings;
+}
+
+// Openings made of `plies` random moves from the start position.
+std::vector<std::string> RandomOpenings(int count, int plies, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::vector<std::string> openings;
+  while (static_cast<int>(openings.size()) < count) {
+    Board board(constants::STARTPOS);
+    bool game_over = false;
+    for (int i = 0; i < plies && !game_over; ++i) {
+      Movelist moves;
+      movegen::legalmoves(moves, board);
+      std::uniform_int_distribution<int> pick(0, moves.size() - 1);
+      board.makeMove(moves[pick(rng)]);
+      game_over = board.isGameOver().second != GameResult::NONE;
+    }
+    if (!game_over) openings.push_back(board.getFen());
+  }
+  return openings;
+}
+
+// Results of engine1 so far.
+struct MatchStats {
+  int wins = 0;
+  int draws = 0;
+  int losses = 0;
+  // Game pairs by engine1's pair score: 0, 0.5, 1, 1.5 or 2 points.
+  std::array<int, 5> pentanomial = {};
+
+  int Pairs() const {
+    int pairs = 0;
+    for (int count : pentanomial) pairs += count;
+    return pairs;
+  }
+
+  // Mean and variance of engine1's score per game, measured over pairs.
+  void ScoreStats(double &mean, double &variance) const {
+    int pairs = Pairs();
+    mean = 0;
+    variance = 0;
+    if (pairs == 0) return;
+    for (int i = 0; i < 5; ++i) mean += pentanomial[i] * (i / 4.0);
+    mean /= pairs;
+    for (int i = 0; i < 5; ++i) {
+      variance += pentanomial[i] * (i / 4.0 - mean) * (i / 4.0 - mean);
+    }
+    variance /= pairs;
+  }
+};
+
+double EloToScore(double elo) { return 1 / (1 + std::pow(10, -elo / 400)); }
+
+double ScoreToElo(double score) {
+  score = std::clamp(score, 1e-6, 1 - 1e-6);
+  return 400 * std::log10(score / (1 - score));
+}
+
+// Log likelihood ratio of H1 over H0, with the pair scores taken as normally
+// distributed (generalized SPRT).
+double LogLikelihoodRatio(const MatchStats &stats, const Options &options) {
+  double mean;
+  double variance;
+  stats.ScoreStats(mean, variance);
+  if (variance <= 0) return 0;
+  double s0 = EloToScore(options.elo0);
+  double s1 = EloToScore(options.elo1);
+  return stats.Pairs() * (s1 - s0) * (2 * mean - s0 - s1) / (2 * variance);
+}
+
+void PrintStatus(const MatchStats &stats, double llr, double lower,
+                 double upper) {
+  double mean;
+  double variance;
+  stats.ScoreStats(mean, variance);
+  double margin = 1.96 * std::sqrt(variance / std::max(stats.Pairs(), 1));
+  double elo = ScoreToElo(mean);
+  std::cout << "pairs " << stats.Pairs() << " wins " << stats.wins
+            << " draws " << stats.draws << " losses " << stats.losses
+            << " pentanomial";
+  for (int count : stats.pentanomial) std::cout << " " << count;
+  std::cout << " elo " << elo << " +/- "
+            << (ScoreToElo(mean + margin) - ScoreToElo(mean - margin)) / 2
+            << " llr " << llr << " (" << lower << ", " << upper << ")"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  std::vector<std::string> engines;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << "missing value for " << arg << std::endl;
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+    if (arg == "--pairs") {
+      options.pairs = std::stoi(value());
+    } else if (arg == "--concurrency") {
+      options.concurrency = std::max(1, std::stoi(value()));
+    } else if (arg == "--tc") {
+      std::string tc = value();
+      size_t plus = tc.find('+');
+      options.bank_s = std::stod(tc.substr(0, plus));
+      options.increment_s =
+          plus == std::string::npos ? 0 : std::stod(tc.substr(plus + 1));
+    } else if (arg == "--openings") {
+      options.openings_file = value();
+    } else if (arg == "--random-plies") {
+      options.random_plies = std::stoi(value());
+    } else if (arg == "--max-plies") {
+      options.max_plies = std::stoi(value());
+    } else if (arg == "--elo0") {
+      options.elo0 = std::stod(value());
+    } else if (arg == "--elo1") {
+      options.elo1 = std::stod(value());
+    } else if (arg == "--alpha") {
+      options.alpha = std::stod(value());
+    } else if (arg == "--beta") {
+      options.beta = std::stod(value());
+    } else if (arg == "--seed") {
+      options.seed = std::stoul(value());
+    } else if (arg == "--uci1") {
+      options.engines[0].uci = true;
+    } else if (arg == "--uci2") {
+      options.engines[1].uci = true;
+    } else {
+      engines.push_back(arg);
+    }
+  }
+  if (engines.size() != 2) {
+    std::cerr << "usage: match [options] <engine1> <engine2>" << std::endl;
+    return 2;
+  }
+  options.engines[0].command = engines[0];
+  options.engines[1].command = engines[1];
+  // A dead engine must not kill the runner when it is written to.
+  signal(SIGPIPE, SIG_IGN);
+
+  std::vector<std::string> openings =
+      options.openings_file.empty()
+          ? RandomOpenings(options.pairs, options.random_plies, options.seed)
+          : ReadOpenings(options.openings_file);
+  if (openings.empty()) {
+    std::cerr << "no openings" << std::endl;
+    return 2;
+  }
+
+  const double lower = std::log(options.beta / (1 - options.alpha));
+  const double upper = std::log((1 - options.beta) / options.alpha);
+  MatchStats stats;
+  double llr = 0;
+  std::mutex mutex;
+  std::atomic<int> next_pair{0};
+  std::atomic<bool> done{false};
+
+  auto worker = [&] {
+    while (!done) {
+      int pair = next_pair++;
+      if (pair >= options.pairs) break;
+      const std::string &opening = openings[pair % openings.size()];
+      const EngineConfig &first = options.engines[0];
+      const EngineConfig &second = options.engines[1];
+      GameOutcome outcomes[2] = {PlayGame(first, second, opening, options),
+                                 PlayGame(second, first, opening, options)};
+      double scores[2] = {outcomes[0].white_score,
+                          1 - outcomes[1].white_score};
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (done) break;
+      for (int game = 0; game < 2; ++game) {
+        std::cerr << "pair " << pair << " game " << game << " engine1 "
+                  << (game == 0 ? "white" : "black") << " score "
+                  << scores[game] << " " << outcomes[game].reason << " "
+                  << opening << std::endl;
+        if (scores[game] == 1) {
+          stats.wins++;
+        } else if (scores[game] == 0) {
+          stats.losses++;
+        } else {
+          stats.draws++;
+        }
+      }
+      stats.pentanomial[std::lround((scores[0] + scores[1]) * 2)]++;
+      llr = LogLikelihoodRatio(stats, options);
+      PrintStatus(stats, llr, lower, upper);
+      if (llr <= lower || llr >= upper) done = true;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.concurrency; ++i) threads.emplace_back(worker);
+  for (auto &thread : threads) thread.join();
+
+  if (llr >= upper) {
+    std::cout << "H1 accepted: elo >= " << options.elo1 << std::endl;
+    return 0;
+  }
+  if (llr <= lower) {
+    std::cout << "H0 accepted: elo <= " << options.elo0 << std::endl;
+    return 1;
+  }
+  std::cout << "inconclusive" << std::endl;
+  return 2;
+}
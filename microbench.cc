@@ -0,0 +1,244 @@
+// Microbenchmarks of the primitives the engine is built from.
+//
+//   g++ -std=c++17 -O2 microbench.cc -o microbench
+//   ./microbench [repetitions] [filter]
+//
+// Each benchmark runs over a corpus of positions: the start and perft
+// positions plus the positions two plies away from them. After a warmup
+// pass, the corpus is timed repetitions times, and the per-operation median
+// and median absolute deviation are printed as one JSON object per line.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./chess.h"
+#include "./eval.h"
+#include "./position.h"
+
+using namespace chess;
+
+static const char *CORPUS_FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+// Keeps results alive so the compiler cannot drop the benchmarked work.
+std::uint64_t sink = 0;
+
+// The corpus positions as FEN. Every seventh position two plies deep is
+// kept, which gives about a thousand positions of all game phases.
+std::vector<std::string> BuildCorpus() {
+  std::vector<std::string> corpus;
+  int counter = 0;
+  for (const char *fen : CORPUS_FENS) {
+    Board board(fen);
+    corpus.push_back(board.getFen());
+    Movelist moves;
+    movegen::legalmoves(moves, board);
+    for (const auto &move : moves) {
+      board.makeMove(move);
+      Movelist replies;
+      movegen::legalmoves(replies, board);
+      for (const auto &reply : replies) {
+        if (counter++ % 7 != 0) continue;
+        board.makeMove(reply);
+        corpus.push_back(board.getFen());
+        board.unmakeMove(reply);
+      }
+      board.unmakeMove(move);
+    }
+  }
+  return corpus;
+}
+
+// Times run() repetitions times after one warmup call. run() does one pass
+// over the corpus and returns the number of operations it performed.
+template <typename F>
+void Bench(const std::string &name, const std::string &filter,
+           int repetitions, F run) {
+  if (name.find(filter) == std::string::npos) return;
+  std::uint64_t ops = run();
+  std::vector<double> ns_per_op;
+  for (int i = 0; i < repetitions; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+    ns_per_op.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count() /
+        std::max<std::uint64_t>(ops, 1));
+  }
+  auto median = [](std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid]
+                             : (values[mid - 1] + values[mid]) / 2;
+  };
+  double med = median(ns_per_op);
+  std::vector<double> deviations;
+  for (double value : ns_per_op) deviations.push_back(std::abs(value - med));
+  std::cout << "{\"name\":\"" << name << "\",\"ops\":" << ops
+            << ",\"repetitions\":" << repetitions << ",\"median_ns\":" << med
+            << ",\"mad_ns\":" << median(deviations) << ",\"min_ns\":"
+            << *std::min_element(ns_per_op.begin(), ns_per_op.end()) << "}"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  int repetitions = argc >= 2 ? std::stoi(argv[1]) : 15;
+  std::string filter = argc >= 3 ? argv[2] : "";
+
+  std::vector<std::string> fens = BuildCorpus();
+  std::vector<Board> boards;
+  std::vector<SearchPosition> positions;
+  std::vector<Movelist> moves(fens.size());
+  for (size_t i = 0; i < fens.size(); ++i) {
+    boards.emplace_back(fens[i]);
+    positions.emplace_back(boards[i]);
+    movegen::legalmoves(moves[i], boards[i]);
+  }
+  std::cerr << "corpus " << fens.size() << " positions" << std::endl;
+
+  Bench("make_unmake_move", filter, repetitions, [&] {
+    std::uint64_t ops = 0;
+    for (size_t i = 0; i < boards.size(); ++i) {
+      for (const auto &move : moves[i]) {
+        boards[i].makeMove(move);
+        sink += boards[i].hash();
+        boards[i].unmakeMove(move);
+        ops++;
+      }
+    }
+    return ops;
+  });
+
+  Bench("make_unmake_null_move", filter, repetitions, [&] {
+    for (auto &board : boards) {
+      board.makeNullMove();
+      sink += board.hash();
+      board.unmakeNullMove();
+    }
+    return boards.size();
+  });
+
+  auto bench_movegen = [&](const std::string &name, auto generate) {
+    Bench(name, filter, repetitions, [&] {
+      Movelist list;
+      for (const auto &board : boards) {
+        generate(list, board);
+        sink += list.size();
+      }
+      return boards.size();
+    });
+  };
+  bench_movegen("legalmoves_all", [](Movelist &list, const Board &board) {
+    movegen::legalmoves<movegen::MoveGenType::ALL>(list, board);
+  });
+  bench_movegen("legalmoves_capture", [](Movelist &list, const Board &board) {
+    movegen::legalmoves<movegen::MoveGenType::CAPTURE>(list, board);
+  });
+  bench_movegen("legalmoves_quiet", [](Movelist &list, const Board &board) {
+    movegen::legalmoves<movegen::MoveGenType::QUIET>(list, board);
+  });
+
+  // Slider lookups from every square with each corpus occupancy.
+  auto bench_slider = [&](const std::string &name, auto lookup) {
+    Bench(name, filter, repetitions, [&] {
+      for (const auto &board : boards) {
+        Bitboard occ = board.occ();
+        for (int sq = 0; sq < 64; ++sq) {
+          sink += lookup(Square(sq), occ).getBits();
+        }
+      }
+      return boards.size() * 64;
+    });
+  };
+  bench_slider("attacks_rook", [](Square sq, Bitboard occ) {
+    return attacks::rook(sq, occ);
+  });
+  bench_slider("attacks_bishop", [](Square sq, Bitboard occ) {
+    return attacks::bishop(sq, occ);
+  });
+
+  std::vector<PackedBoard> packed;
+  for (const auto &board : boards) {
+    packed.push_back(Board::Compact::encode(board));
+  }
+  Bench("compact_encode", filter, repetitions, [&] {
+    for (const auto &board : boards) {
+      sink += Board::Compact::encode(board)[0];
+    }
+    return boards.size();
+  });
+  Bench("compact_decode", filter, repetitions, [&] {
+    for (const auto &compressed : packed) {
+      sink += Board::Compact::decode(compressed).hash();
+    }
+    return packed.size();
+  });
+
+  Bench("board_from_fen", filter, repetitions, [&] {
+    for (const auto &fen : fens) sink += Board(fen).hash();
+    return fens.size();
+  });
+  Bench("get_fen", filter, repetitions, [&] {
+    for (const auto &board : boards) sink += board.getFen().size();
+    return boards.size();
+  });
+
+  std::vector<std::vector<std::string>> sans(boards.size());
+  for (size_t i = 0; i < boards.size(); ++i) {
+    for (const auto &move : moves[i]) {
+      sans[i].push_back(uci::moveToSan(boards[i], move));
+    }
+  }
+  Bench("move_to_san", filter, repetitions, [&] {
+    std::uint64_t ops = 0;
+    for (size_t i = 0; i < boards.size(); ++i) {
+      for (const auto &move : moves[i]) {
+        sink += uci::moveToSan(boards[i], move).size();
+        ops++;
+      }
+    }
+    return ops;
+  });
+  Bench("parse_san", filter, repetitions, [&] {
+    std::uint64_t ops = 0;
+    for (size_t i = 0; i < boards.size(); ++i) {
+      for (const auto &san : sans[i]) {
+        sink += uci::parseSan(boards[i], san).move();
+        ops++;
+      }
+    }
+    return ops;
+  });
+  Bench("parse_san_fast", filter, repetitions, [&] {
+    std::uint64_t ops = 0;
+    for (size_t i = 0; i < boards.size(); ++i) {
+      for (const auto &san : sans[i]) {
+        Move move;
+        sink += static_cast<int>(uci::parseSanFast(boards[i], san, move));
+        sink += move.move();
+        ops++;
+      }
+    }
+    return ops;
+  });
+
+  Bench("evaluate", filter, repetitions, [&] {
+    for (const auto &position : positions) sink += Evaluate(position);
+    return positions.size();
+  });
+
+  std::cerr << "sink " << sink << std::endl;
+  return 0;
+}
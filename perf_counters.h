@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters of the calling thread through Linux perf_event_open.
+// Counters the kernel or CPU does not provide (containers, VMs, other
+// systems) read as unavailable instead of failing.
+class PerfCounters {
+ public:
+  enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    NUM_EVENTS
+  };
+
+  static constexpr const char *EVENT_NAMES[NUM_EVENTS] = {
+      "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+  PerfCounters() {
+#if defined(__linux__)
+    constexpr std::uint64_t L1D_READ_MISS =
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    Open(CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    Open(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    Open(L1D_MISSES, PERF_TYPE_HW_CACHE, L1D_READ_MISS);
+    Open(LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    Open(BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+  }
+
+  ~PerfCounters() {
+#if defined(__linux__)
+    for (int fd : fds_) {
+      if (fd >= 0) close(fd);
+    }
+#endif
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  bool Available(Event event) const { return fds_[event] >= 0; }
+
+  // Resets and starts all counters.
+  void Start() {
+#if defined(__linux__)
+    for (int event = 0; event < NUM_EVENTS; ++event) {
+      if (fds_[event] < 0) continue;
+      ioctl(fds_[event], PERF_EVENT_IOC_RESET, 0);
+      // The enabled and running times are not reset, keep their start.
+      ReadRaw(event, start_[event]);
+      ioctl(fds_[event], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  void Stop() {
+#if defined(__linux__)
+    for (int fd : fds_) {
+      if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+  }
+
+  // Count since the last Start(), scaled up if the kernel had to multiplex
+  // the counter. 0 when unavailable.
+  std::uint64_t Read(Event event) const {
+#if defined(__linux__)
+    std::uint64_t values[3];
+    if (fds_[event] < 0 || !ReadRaw(event, values)) return 0;
+    std::uint64_t enabled = values[1] - start_[event][1];
+    std::uint64_t running = values[2] - start_[event][2];
+    if (running == 0) return 0;
+    if (running < enabled) {
+      return static_cast<std::uint64_t>(static_cast<double>(values[0]) *
+                                        enabled / running);
+    }
+    return values[0];
+#else
+    return 0;
+#endif
+  }
+
+ private:
+#if defined(__linux__)
+  void Open(Event event, std::uint32_t type, std::uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds_[event] = static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+  // Reads value, time enabled and time running.
+  bool ReadRaw(int event, std::uint64_t (&values)[3]) const {
+    return read(fds_[event], values, sizeof(values)) == sizeof(values);
+  }
+#endif
+
+  int fds_[NUM_EVENTS] = {-1, -1, -1, -1, -1};
+  std::uint64_t start_[NUM_EVENTS][3] = {};
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+#include "./chess.h"
+
+using namespace chess;
+
+// Position used by the search. Unlike chess::Board it has no undo history,
+// no vtable and no FEN bookkeeping, so it is trivially copyable (144 bytes).
+// Moves are applied with copy-make: copy the parent into the child's slot and
+// call makeMove() on the copy.
+//
+// The accessors mirror chess::Board, so movegen::legalmoves() and the
+// evaluation accept either type.
+class SearchPosition {
+ public:
+  SearchPosition() = default;
+
+  explicit SearchPosition(const Board &board) {
+    for (int type = 0; type < 6; ++type) {
+      pieces_bb_[type] = board.pieces(PieceType(static_cast<PieceType::underlying>(type)));
+    }
+    occ_bb_[0] = board.us(Color::WHITE);
+    occ_bb_[1] = board.us(Color::BLACK);
+    for (int sq = 0; sq < 64; ++sq) board_[sq] = board.at(Square(sq));
+    key_ = board.hash();
+    cr_ = board.castlingRights();
+    ep_sq_ = board.enpassantSq().index();
+    stm_ = board.sideToMove();
+    hfm_ = board.halfMoveClock();
+  }
+
+  Bitboard us(Color color) const { return occ_bb_[color]; }
+  Bitboard them(Color color) const { return us(~color); }
+  Bitboard occ() const { return occ_bb_[0] | occ_bb_[1]; }
+  Bitboard pieces(PieceType type, Color color) const {
+    return pieces_bb_[type] & occ_bb_[color];
+  }
+  Bitboard pieces(PieceType type) const { return pieces_bb_[type]; }
+  Square kingSq(Color color) const {
+    return pieces(PieceType::KING, color).lsb();
+  }
+
+  template <typename T = Piece>
+  T at(Square sq) const {
+    if constexpr (std::is_same_v<T, PieceType>) {
+      return board_[sq.index()].type();
+    } else {
+      return board_[sq.index()];
+    }
+  }
+
+  bool isCapture(const Move move) const {
+    return (at(move.to()) != Piece::NONE && move.typeOf() != Move::CASTLING) ||
+           move.typeOf() == Move::ENPASSANT;
+  }
+
+  std::uint64_t hash() const { return key_; }
+  Color sideToMove() const { return stm_; }
+  Square enpassantSq() const { return Square(ep_sq_); }
+  Board::CastlingRights castlingRights() const { return cr_; }
+  std::uint32_t halfMoveClock() const { return hfm_; }
+  bool chess960() const { return false; }
+
+  bool isAttacked(Square square, Color color) const {
+    if (attacks::pawn(~color, square) & pieces(PieceType::PAWN, color))
+      return true;
+    if (attacks::knight(square) & pieces(PieceType::KNIGHT, color)) return true;
+    if (attacks::king(square) & pieces(PieceType::KING, color)) return true;
+    Bitboard bishops = pieces(PieceType::BISHOP, color) |
+                       pieces(PieceType::QUEEN, color);
+    if (attacks::bishop(square, occ()) & bishops) return true;
+    Bitboard rooks =
+        pieces(PieceType::ROOK, color) | pieces(PieceType::QUEEN, color);
+    if (attacks::rook(square, occ()) & rooks) return true;
+    return false;
+  }
+
+  bool inCheck() const { return isAttacked(kingSq(stm_), ~stm_); }
+
+  // Whether a legal move checks the opponent, without making it.
+  bool givesCheck(const Move move, const movegen::CheckInfo &info) const {
+    return movegen::givesCheck(*this, move, info);
+  }
+
+  // Validation of moves from elsewhere (PV, killers, hash), see movegen.
+  bool isPseudoLegal(const Move move) const {
+    return movegen::isPseudoLegal(*this, move);
+  }
+  bool isLegal(const Move move) const { return movegen::isLegal(*this, move); }
+  bool isLegal(const Move move, const movegen::NodeInfo &info) const {
+    return movegen::isLegal(*this, move, info);
+  }
+
+  bool hasNonPawnMaterial(Color color) const {
+    return bool(pieces(PieceType::KNIGHT, color) |
+                pieces(PieceType::BISHOP, color) |
+                pieces(PieceType::ROOK, color) |
+                pieces(PieceType::QUEEN, color));
+  }
+
+  // Applies a legal move. Same semantics and hash as Board::makeMove<false>:
+  // the en passant square is only set when an enemy pawn attacks it.
+  void makeMove(const Move move) {
+    const Square from = move.from();
+    const Square to = move.to();
+    const Piece piece = at(from);
+    const PieceType pt = piece.type();
+    const Piece captured = at(to);
+    const bool castling = move.typeOf() == Move::CASTLING;
+
+    hfm_++;
+
+    if (ep_sq_ != NO_EP) key_ ^= Zobrist::enpassant(Square(ep_sq_).file());
+    ep_sq_ = NO_EP;
+
+    key_ ^= Zobrist::castling(cr_.hashIndex());
+
+    if (captured != Piece::NONE && !castling) {
+      removePiece(captured, to);
+      hfm_ = 0;
+
+      // remove castling rights if rook is captured
+      if (captured.type() == PieceType::ROOK &&
+          Rank::back_rank(to.rank(), ~stm_)) {
+        const auto side =
+            Board::CastlingRights::closestSide(to, kingSq(~stm_));
+        if (cr_.getRookFile(~stm_, side) == to.file()) cr_.clear(~stm_, side);
+      }
+    }
+
+    if (pt == PieceType::KING) {
+      cr_.clear(stm_);
+    } else if (pt == PieceType::ROOK && Square::back_rank(from, stm_)) {
+      const auto side = Board::CastlingRights::closestSide(from, kingSq(stm_));
+      if (cr_.getRookFile(stm_, side) == from.file()) cr_.clear(stm_, side);
+    } else if (pt == PieceType::PAWN) {
+      hfm_ = 0;
+      if (Square::value_distance(to, from) == 16 &&
+          (attacks::pawn(stm_, to.ep_square()) &
+           pieces(PieceType::PAWN, ~stm_))) {
+        ep_sq_ = to.ep_square().index();
+        key_ ^= Zobrist::enpassant(to.file());
+      }
+    }
+
+    key_ ^= Zobrist::castling(cr_.hashIndex());
+
+    if (castling) {
+      const bool king_side = to > from;
+      const auto rook_to = Square::castling_rook_square(king_side, stm_);
+      const auto king_to = Square::castling_king_square(king_side, stm_);
+      const Piece rook = captured;
+
+      removePiece(piece, from);
+      removePiece(rook, to);
+      placePiece(piece, king_to);
+      placePiece(rook, rook_to);
+    } else if (move.typeOf() == Move::PROMOTION) {
+      removePiece(piece, from);
+      placePiece(Piece(move.promotionType(), stm_), to);
+    } else {
+      removePiece(piece, from);
+      placePiece(piece, to);
+      if (move.typeOf() == Move::ENPASSANT) {
+        removePiece(Piece(PieceType::PAWN, ~stm_), to.ep_square());
+      }
+    }
+
+    key_ ^= Zobrist::sideToMove();
+    stm_ = ~stm_;
+  }
+
+  void makeNullMove() {
+    key_ ^= Zobrist::sideToMove();
+    if (ep_sq_ != NO_EP) key_ ^= Zobrist::enpassant(Square(ep_sq_).file());
+    ep_sq_ = NO_EP;
+    stm_ = ~stm_;
+  }
+
+ private:
+  static constexpr std::uint8_t NO_EP = 64;
+
+  void removePiece(Piece piece, Square sq) {
+    pieces_bb_[piece.type()].clear(sq.index());
+    occ_bb_[piece.color()].clear(sq.index());
+    board_[sq.index()] = Piece::NONE;
+    key_ ^= Zobrist::piece(piece, sq);
+  }
+
+  void placePiece(Piece piece, Square sq) {
+    pieces_bb_[piece.type()].set(sq.index());
+    occ_bb_[piece.color()].set(sq.index());
+    board_[sq.index()] = piece;
+    key_ ^= Zobrist::piece(piece, sq);
+  }
+
+  std::array<Bitboard, 6> pieces_bb_ = {};
+  std::array<Bitboard, 2> occ_bb_ = {};
+  std::array<Piece, 64> board_ = {};
+  std::uint64_t key_ = 0;
+  Board::CastlingRights cr_ = {};
+  std::uint8_t ep_sq_ = NO_EP;
+  Color stm_ = Color::WHITE;
+  std::uint8_t hfm_ = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<SearchPosition>);
+static_assert(sizeof(SearchPosition) == 144);
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Search profiling counters. They are compiled in with -DSEARCH_STATS and
+// printed as one JSON line per move on stderr. Without it every counter and
+// timer below compiles to nothing.
+#ifdef SEARCH_STATS
+constexpr bool SEARCH_STATS_ENABLED = true;
+#else
+constexpr bool SEARCH_STATS_ENABLED = false;
+#endif
+
+// Parts of the search timed by ScopedTimer.
+enum class Timer { MOVEGEN, EVAL, MAKE_MOVE, ORDERING, COUNT };
+
+struct SearchStats {
+  std::uint64_t main_nodes;
+  std::uint64_t qsearch_nodes;
+  // Fail highs in the negamax move loop, and how many came from the first
+  // move searched.
+  std::uint64_t beta_cutoffs;
+  std::uint64_t first_move_cutoffs;
+  std::uint64_t null_move_searches;
+  std::uint64_t null_move_cutoffs;
+  std::uint64_t lmr_searches;
+  std::uint64_t lmr_re_searches;
+  // Zero window searches that had to be repeated with the full window.
+  std::uint64_t pvs_re_searches;
+  std::uint64_t repetition_lookups;
+  // Indexed by movegen::MoveGenType.
+  std::uint64_t movegen_calls[3];
+  std::uint64_t sorts;
+  std::uint64_t sorted_moves;
+  // Time stamp counter ticks, indexed by Timer.
+  std::uint64_t ticks[static_cast<int>(Timer::COUNT)];
+};
+
+inline thread_local SearchStats search_stats;
+
+inline void ResetSearchStats() {
+  if constexpr (SEARCH_STATS_ENABLED) search_stats = {};
+}
+
+// Adds n to a counter, e.g. CountStat(&SearchStats::main_nodes).
+inline void CountStat(std::uint64_t SearchStats::*counter,
+                      std::uint64_t n = 1) {
+  if constexpr (SEARCH_STATS_ENABLED) search_stats.*counter += n;
+}
+
+inline void CountMovegen(int type) {
+  if constexpr (SEARCH_STATS_ENABLED) search_stats.movegen_calls[type]++;
+}
+
+inline std::uint64_t ReadTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Adds the ticks spent in its scope to a Timer.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Timer timer) : timer_(timer) {
+    if constexpr (SEARCH_STATS_ENABLED) start_ = ReadTicks();
+  }
+
+  ~ScopedTimer() {
+    if constexpr (SEARCH_STATS_ENABLED) {
+      search_stats.ticks[static_cast<int>(timer_)] += ReadTicks() - start_;
+    }
+  }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+ private:
+  Timer timer_;
+  std::uint64_t start_ = 0;
+};
+
+// Writes the counters as a single line JSON object.
+inline void PrintSearchStats(std::ostream &out, int depth, int time_ms) {
+  const SearchStats &s = search_stats;
+  auto ratio = [](std::uint64_t a, std::uint64_t b) {
+    return b == 0 ? 0.0 : static_cast<double>(a) / b;
+  };
+  out << "{\"depth\":" << depth << ",\"time_ms\":" << time_ms
+      << ",\"main_nodes\":" << s.main_nodes
+      << ",\"qsearch_nodes\":" << s.qsearch_nodes
+      << ",\"beta_cutoffs\":" << s.beta_cutoffs
+      << ",\"first_move_cutoff_rate\":"
+      << ratio(s.first_move_cutoffs, s.beta_cutoffs)
+      << ",\"null_move_searches\":" << s.null_move_searches
+      << ",\"null_move_cutoff_rate\":"
+      << ratio(s.null_move_cutoffs, s.null_move_searches)
+      << ",\"lmr_searches\":" << s.lmr_searches
+      << ",\"lmr_re_search_rate\":" << ratio(s.lmr_re_searches, s.lmr_searches)
+      << ",\"pvs_re_searches\":" << s.pvs_re_searches
+      << ",\"repetition_lookups\":" << s.repetition_lookups
+      << ",\"movegen_calls\":{\"all\":" << s.movegen_calls[0]
+      << ",\"capture\":" << s.movegen_calls[1]
+      << ",\"quiet\":" << s.movegen_calls[2] << "}"
+      << ",\"sorts\":" << s.sorts
+      << ",\"avg_sort_size\":" << ratio(s.sorted_moves, s.sorts)
+      << ",\"ticks\":{\"movegen\":" << s.ticks[0] << ",\"eval\":" << s.ticks[1]
+      << ",\"make_move\":" << s.ticks[2] << ",\"ordering\":" << s.ticks[3]
+      << "}}" << std::endl;
+}